@@ -53,8 +53,13 @@
 		/** Size in bytes of the CDC device-to-host notification IN endpoint. */
 		#define CDC_NOTIFICATION_EPSIZE        8
 
-		/** Size in bytes of the CDC data IN and OUT endpoints. */
-		#define CDC_TXRX_EPSIZE                16
+		/** Size in bytes of the CDC data IN endpoint, double banked. */
+		#define CDC_TX_EPSIZE                  64
+
+		/** Size in bytes of the CDC data OUT endpoint. The IN banks, this and the 8 byte control and notification
+		 *  endpoints take all 176 bytes of the ATmega32U2's endpoint memory.
+		 */
+		#define CDC_RX_EPSIZE                  32
 
 	/* Type Defines: */
 		/** Type define for the device configuration descriptor structure. This must be defined in the
@@ -21,13 +21,13 @@
 // B.3			Input			SPI Input from MAX6675			(MISO)
 // B.4			Output		Dynamic Element Control (SSR)
 // B.5			Output		Oven Power Cuttoff (EMR)
-// B.6			Output		Spare output
+// B.6			Input			Mains zero-cross detector, optional	(PCINT6, pull-up)
 // B.7			Output		Spare output
 //
-// C.4			Input			Switch 1
-// C.5			Input			Switch 2
-// C.6			Input			Switch 3
-// C.7			Input			Switch 0
+// C.4			Input			Switch 1 (ENTER, pin change)
+// C.5			Input			Switch 2 (MENU, pin change, also aborts a run)
+// C.6			Input			Switch 3 (UP, pin change)
+// C.7			Input			Switch 0 (DOWN, INT4 on either edge)
 //
 // D.0			Output		LCD DB4
 // D.1			Output		LCD DB5
@@ -55,10 +55,16 @@
 #include "../LUFA/LUFA/Drivers/USB/USB.h"
 
 #include "ReflowOven.h"
+#include "control.h"
 #include "lcd.h"
 #include "spi.h"
 #include "menu.h"
 #include "pid.h"
+#include "scheduler.h"
+#include "buttons.h"
+#include "telemetry.h"
+#include "usbtx.h"
+#include "usbrx.h"
 //#include "version.h"
 
 //==============================================================================================================================
@@ -82,56 +88,14 @@ extern uint8_t CurrentMenuItemIdx;
 
 #define buildstr "34"
 
-#define OVEN_RELAY_SSR		PB4
-#define OVEN_RELAY_EMR		PB5
-
-#define EMR_ON						PORTB &= ~_BV(OVEN_RELAY_EMR)
-#define EMR_OFF						PORTB |= _BV(OVEN_RELAY_EMR)
-
-#define SSR_ON						PORTB |= _BV(OVEN_RELAY_SSR)
-#define SSR_OFF						PORTB &= ~_BV(OVEN_RELAY_SSR)
-
-//==============================================================================================================================
-// Typedefs
-
-typedef struct
-{
-	char name[PROFILE_NAME_LEN];
-	unsigned char calibrated;
-	unsigned char preheat_temp;
-	unsigned char soak_dutycycle;
-	unsigned char soak_rate;
-	unsigned char soak_time;
-	unsigned char soak_temp;
-	unsigned char reflow_time;
-	unsigned char reflow_temp;
-	unsigned char preheat_cutoff;
-	unsigned char reflow_cutoff;
-} __profile;
+#define PROFILE_SETTINGS	10	// calibrated to reflow_cutoff, the bytes that follow the name in __profile
+#define PROFILE_REPLY_MAX	72	// Longest =PGET line
 
 //==============================================================================================================================
 // EEPROM Variables and Data
 
 uint8_t __attribute__((section(".validapp"))) ValidApp = 0xBB;
 
-uint8_t EEMEM OvenCalibrated = 1;
-uint8_t EEMEM ProfileCount = 3;
-
-__profile EEMEM Profiles[MAX_PROFILES] = 
-{
-	{"Default         ",1,150,8,8,60,180,60,215,131,206},			  // for small low density boards
-	{"Bigger Board    ",1,150,6,8,120,180,90,215,138,206},			// for larger high density boards
-	{"Leadfree        ",1,150,12,8,120,200,120,255,138,248} 
-};
-
-//__profile EEMEM Profiles[MAX_PROFILES] = {{"Leadfree",1,150,3,2,200,120,255,138,248}}; //perfect for leaded solder
-// original production profile that was used in the first 2 years __profile EEMEM Profiles[MAX_PROFILES] = {{"Default",1,150,2,4,180,90,215,124,204}};
-// setup __profile EEMEM Profiles[MAX_PROFILES] = {{"Default",0,150,2,4,180,90,220,0,0}};
-// 210 reflow __profile EEMEM Profiles[MAX_PROFILES] = {{"Default",1,150,2,4,180,90,210,123,199}};
-
-uint8_t EEMEM TempCounts[20] = {18,14,14,15,11,10,11,11,10,12,11,12,12,11,12,13,18,15,16,16};
-uint16_t EEMEM FinalTemps[20] = {77,117,153,185,213,237,257,0,0,0,0,0,0,0,0,0,0,0,0,0};
-
 //==============================================================================================================================
 // PROGMEM Menu definition
 
@@ -179,15 +143,19 @@ const char Str22[] PROGMEM = "PID Test        ";
 const char Str23[] PROGMEM = "Calib. Profile  ";
 const char Str24[] PROGMEM = "Calib. 60c      ";
 const char Str25[] PROGMEM = "Calib. 120c     ";
+const char Str26[] PROGMEM = "Autotune PID    ";
+const char Str27[] PROGMEM = "Stepped Cal.    ";
 
 const MENU_ITEM SettingsMenu[] PROGMEM =
 {
 	{MENU_ITEM_TYPE_SUB_MENU_HEADER, Str20, (PGM_P)MainMenu},
-	{MENU_ITEM_TYPE_COMMAND, Str21, (PGM_P)CalibrateOvenCommand},
+	{MENU_ITEM_TYPE_COMMAND, Str21, (PGM_P)IdentifyOvenCommand},
 	{MENU_ITEM_TYPE_COMMAND, Str22, (PGM_P)PIDTestCommand},
 	{MENU_ITEM_TYPE_COMMAND, Str23, (PGM_P)CalibrateProfileCommand},
 	{MENU_ITEM_TYPE_COMMAND, Str24, (PGM_P)Calibrate60cCommand},
 	{MENU_ITEM_TYPE_COMMAND, Str25, (PGM_P)Calibrate120cCommand},
+	{MENU_ITEM_TYPE_COMMAND, Str26, (PGM_P)AutotuneCommand},
+	{MENU_ITEM_TYPE_COMMAND, Str27, (PGM_P)CalibrateOvenCommand},
 	{MENU_ITEM_TYPE_END_OF_MENU, NULL, 0}
 };
 
@@ -208,13 +176,13 @@ USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface =
 		.DataINEndpoint           =
 		{
 			.Address          = CDC_TX_EPADDR,
-			.Size             = CDC_TXRX_EPSIZE,
-			.Banks            = 1,
+			.Size             = CDC_TX_EPSIZE,
+			.Banks            = 2,
 		},
 		.DataOUTEndpoint =
 		{
 			.Address          = CDC_RX_EPADDR,
-			.Size             = CDC_TXRX_EPSIZE,
+			.Size             = CDC_RX_EPSIZE,
 			.Banks            = 1,
 		},
 		.NotificationEndpoint =
@@ -226,75 +194,30 @@ USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface =
 	},
 };
 
-static FILE USBSerialStream;
+FILE USBSerialStream;
 char inBuf[80];
 char tmpStr[17];
 char profileName[PROFILE_NAME_LEN];
 uint8_t currentProfile = 1;
+static uint8_t pgetNext = 0; // Next profile for a **PGET of them all, 0 when there are none left to send
+static bool ready = false; // The splash screen is over and the scheduler is running, runs can start
 bool usbConnected = false;
-bool isRunning = false;
-bool showTemp = true;
-uint32_t ovenTempAccum = 0;
-uint16_t ovenTemp;
-uint16_t ovenEndTemp;
-uint16_t ovenTempArray[68];
-uint16_t ovenDelta4Array[12] = {0xFFFF};
-int16_t ovenDelta4;
-int16_t ovenDelta16;
-int16_t ovenDelta32;
-int16_t ovenRateOfChange;
-uint8_t deltaCount = 0;
-uint8_t ovenStage; // Used to store where a task is up to
-uint16_t ovenCounter;
-int16_t ovenError = 0;
-void(*ProcessHandler)();
-uint16_t count = 0;
-uint16_t endCount = 3600;
-uint8_t endSet = 0;
-__profile profile;
-volatile uint8_t tick = 0;
-volatile bool readtick = 0;
-volatile uint8_t subtickCounter = 0;
-volatile uint8_t duty_cycle = 0;
-uint8_t readings = 0;
 bool lcdPresent = true;
 uint8_t buttons = 0;
 uint8_t newButton;
-PIDController pid;
 
-//==============================================================================================================================
-// Interrupt routines
+// Main loop tasks, in the order they run in a pass. The panel goes first so a new button reaches the stage handler in
+// the same pass.
+const char TaskPanel[] PROGMEM = "panel";
+const char TaskControl[] PROGMEM = "control";
+const char TaskUsb[] PROGMEM = "usb";
 
-ISR (TIMER1_COMPA_vect)
+TASK tasks[] =
 {
-	subtickCounter++;
-	if (subtickCounter == 100)
-	{
-		subtickCounter = 0;
-	}
-
-	if ((subtickCounter % 10) == 0)
-	{
-		readtick = ((subtickCounter % 10) == 0);
-	}
-
-  if ((subtickCounter == 0) || (subtickCounter == 50))
-	{
-		tick++;
-	}
-	
-	if ((duty_cycle > 0) && (duty_cycle < 100))
-	{
-		if (subtickCounter == duty_cycle)
-		{
-			SSR_OFF;
-		}
-		else if (subtickCounter == 0)
-		{
-			SSR_ON;
-		}
-	}
-}
+	{TaskPanel, PanelTask, NULL, 10, 10},						// Buttons every timer slot
+	{TaskControl, ControlRun, ControlReady, 0, 100},	// Within the fastest control tick
+	{TaskUsb, UsbTask, NULL, 0, 10}									// After every wake up
+};
 
 //==============================================================================================================================
 // Get the menu item at a given index from EEMEM
@@ -313,11 +236,13 @@ void EVENT_USB_Device_Connect(void)
 }
 
 //==============================================================================================================================
-// Event handler for the library USB Disconnection event
+// Event handler for the library USB Disconnection event, called from the USB interrupt so it only stops the writes and
+// leaves the rest of closing the port to UsbTask
 
 void EVENT_USB_Device_Disconnect(void)
 {
 	usbConnected = false;
+	UsbTxSetReader(false);
 }
 
 //==============================================================================================================================
@@ -328,6 +253,8 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 	bool ConfigSuccess = true;
 
 	ConfigSuccess &= CDC_Device_ConfigureEndpoints(&VirtualSerial_CDC_Interface);
+
+	USB_Device_EnableSOFEvents(); // The start of frame interrupt wakes the main loop every 1ms to service the endpoints
 }
 
 //==============================================================================================================================
@@ -339,25 +266,17 @@ void EVENT_USB_Device_ControlRequest(void)
 }
 
 //==============================================================================================================================
-// Functions
+// Event handler for the CDC class driver Control Line State Changed event, the host raises DTR while a program has the
+// port open
 
-uint8_t GetPacket(char* buf, uint8_t size)
+void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
 {
-	if (CDC_Device_BytesReceived(&VirtualSerial_CDC_Interface))
-	{
-		fgets(buf, size, &USBSerialStream);
-//		printf("$$%s$$\n", buf);
-		while ((strlen(buf) > 0) && ((buf[strlen(buf)-1] == '\r') || (buf[strlen(buf)-1] == '\n')))
-		{
-			buf[strlen(buf)-1] = 0;
-		}
-//		printf("##%s##\n", inBuf);
-		return true;
-	}
-	
-	return false;
+	HostListening(CDCInterfaceInfo->State.ControlLineStates.HostToDevice & CDC_CONTROL_LINE_OUT_DTR);
 }
 
+//==============================================================================================================================
+// Functions
+
 //==============================================================================================================================
 // Configure the various bits of hardware
 
@@ -368,6 +287,13 @@ void SetupHardware(void)
 	DDRB |= _BV(OVEN_RELAY_SSR) | _BV(OVEN_RELAY_EMR); // Relay outputs
 	DDRD |= _BV(PD7); // Buzzer as output
 	PORTC = 0xF0; // Enable pullups on for switches
+	PORTB |= _BV(ZERO_CROSS_PIN); // Pullup on the zero-cross input, it stays high if there is no detector
+	PCMSK0 = _BV(PCINT6);
+	PCMSK1 = _BV(PCINT8) | _BV(PCINT9) | _BV(PCINT10); // C.6 to C.4 buttons, MENU also for the safety supervisor
+	PCICR = _BV(PCIE0) | _BV(PCIE1);
+	EICRB = _BV(ISC40); // C.7 button has no pin change, INT4 on either edge instead
+	EIMSK = _BV(INT4);
+	setControlRate(eeprom_read_byte(&ControlRate)); // Stays at the default if the EEPROM holds something else
 
 	// Initialise SPI
   spi_init ();
@@ -384,122 +310,24 @@ void SetupHardware(void)
 	// Setup Timer/Counter1
 	TCCR1A = 0;
 	TCCR1B = (1 << WGM12) | (1 << CS11) | (1 << CS10);
-	OCR1A = 1250; // = 0.01 seconds
+	OCR1A = TIMER1_PERIOD; // = 0.01 seconds
 //	OCR1A = 6250; // = 0.05 seconds
 //	OCR1A = 12500; // = 0.1 seconds
 //	OCR1A = 62500; // = 0.5 seconds
 	TIMSK1 = (1 << OCIE1A);
 }
 
-//==============================================================================================================================
-// Read temperature
-uint16_t ReadTemp ()
-{
-  return spi_read();	
-}
-
-
-//==============================================================================================================================
-// Send a temperature packet
-
-void UpdateTemp (void)
-{
-	char str[20];
-
-	ovenTemp = ovenTempAccum>>2;
-	ovenTempAccum = 0;
-	
-	if (ovenTempArray[0] == 0)
-	{
-		for (uint8_t i = 0; i < 68; i++)
-		{
-			ovenTempArray[i] = ovenTemp;
-		}
-	}
-	else
-	{
-		memmove(&ovenTempArray[1], &ovenTempArray[0], sizeof(uint16_t)*67);
-		ovenTempArray[0] = ovenTemp;
-	}
-	
-	ovenDelta4 = (int16_t)(ovenTempArray[0]+ovenTempArray[1]+ovenTempArray[2]+ovenTempArray[3]-ovenTempArray[8]-ovenTempArray[9]-ovenTempArray[10]-ovenTempArray[11]);
-	ovenDelta16 = (int16_t)(ovenTempArray[0]+ovenTempArray[1]+ovenTempArray[2]+ovenTempArray[3]-ovenTempArray[32]-ovenTempArray[33]-ovenTempArray[34]-ovenTempArray[35]);
-	ovenDelta32 = (int16_t)(ovenTempArray[0]+ovenTempArray[1]+ovenTempArray[2]+ovenTempArray[3]-ovenTempArray[64]-ovenTempArray[65]-ovenTempArray[66]-ovenTempArray[67]);
-
-	if (ovenDelta4Array[0] == 0xFFFF)
-	{
-		for (uint8_t i = 0; i < 12; i++)
-		{
-			ovenDelta4Array[i] = ovenDelta4;
-		}
-	}
-	else
-	{
-		memmove(&ovenDelta4Array[1], &ovenDelta4Array[0], sizeof(uint16_t)*11);
-		ovenDelta4Array[0] = ovenDelta4;
-	}
-	
-	ovenRateOfChange = (int16_t)(ovenDelta4Array[0]+ovenDelta4Array[1]+ovenDelta4Array[2]+ovenDelta4Array[3]-ovenDelta4Array[8]-ovenDelta4Array[9]-ovenDelta4Array[10]-ovenDelta4Array[11]);
-
-	if (lcdPresent)
-	{
-		lcd_gotoxy(10, 0);
-	}
-
-	if (ovenTemp >= 65533)
-	{
-	  setDutyCycle(0); //Turn off SSR
-	  _delay_ms(25); //Wait for SSR to power down
-	  EMR_OFF; // Turn off EMR
-		if (ovenTemp == 65535)
-		{
-			sprintf_P (str, PSTR("No TC "));
-		}
-		else if (ovenTemp == 65534)			
-		{
-			sprintf_P (str, PSTR("SG Err"));
-		}
-		else
-		{
-			sprintf_P (str, PSTR("SV Err"));
-		}
-		if ((lcdPresent) && (showTemp))
-		{
-			lcd_puts (str);
-		}		
-		fprintf (&USBSerialStream, "%u,%u,%s\n", ovenStage, count, str);
-	}
-	else
-	{
-		sprintf_P (str, PSTR("%3u.%02u"), ovenTemp>>2, (ovenTemp & 0x03)*25);
-		if ((lcdPresent) && (showTemp))
-		{
-			lcd_puts (str);
-		}
-		fprintf_P (&USBSerialStream, PSTR("%u,%u,%s,%u, %d,%d,%d, %d,%d\n"), ovenStage, count, str, duty_cycle, ovenDelta4, ovenDelta16, ovenDelta32, ovenRateOfChange, ovenError);
-	}
-
-	count++;
-}
-
 //==============================================================================================================================
 // Send the oven settings
 
 void SendOvenSettings(void)
 {
-	char ReportString[80];
-	
-	sprintf_P(ReportString, PSTR("=OGET,%u,%u,%u"), eeprom_read_byte(&OvenCalibrated), MAX_PROFILES, eeprom_read_byte(&ProfileCount));
+	fprintf_P(&USBSerialStream, PSTR("=OGET,%u,%u,%u"), eeprom_read_byte(&OvenCalibrated), MAX_PROFILES, eeprom_read_byte(&ProfileCount));
 	for (uint8_t i = 0; i < 20; i++)
 	{
-		sprintf_P(tmpStr, PSTR(",%u"), eeprom_read_byte(&TempCounts[i]));
-		strcat(ReportString, tmpStr);
+		fprintf_P(&USBSerialStream, PSTR(",%u"), eeprom_read_byte(&TempCounts[i]));
 	}
-	
-	strcat(ReportString,"\n");
-	
-	// Write the string to the virtual COM port via the created character stream
-	fputs(ReportString, &USBSerialStream);
+	fputc('\n', &USBSerialStream);
 }
 
 //==============================================================================================================================
@@ -522,1107 +350,409 @@ void Bootloader(void)
 //==============================================================================================================================
 //
 
-void setDutyCycle (uint8_t ratio)
+void SelectProfileCommand()
 {
-	duty_cycle = ratio;
-	if (duty_cycle == 0)
-	{
-		SSR_OFF;
-	}
-	if (duty_cycle == 100)
-	{
-		SSR_ON;
-	}
-}
+	currentProfile = CurrentMenuItemIdx;
+	eeprom_read_block ((void*)&profile, (const void*)&Profiles[currentProfile-1], sizeof(__profile));
+};
 
 //==============================================================================================================================
 //
 
-uint8_t getDutyCycle(uint16_t temp)
+void EditProfileCommand()
 {
-	uint8_t i;
-	
-	for (i = 0; i < 20; i++)
-	{
-		if (temp <= eeprom_read_word(&FinalTemps[i]))
-		{
-			return (i+1)*5;
-		}
-	}
-	return 0;
-}
+};
 
 //==============================================================================================================================
 //
 
-void printProfile (void)
+void CalibrateProfileCommand()
+{
+};
+
+//==============================================================================================================================
+// Start or stop sending when a program opens or closes the port. Nothing is sent while no one is reading, so the control
+// loop does the same work either way, and a reader starts at a =SYNC,<stage> line with nothing stale ahead of it.
+
+void HostListening(bool listening)
 {
-	fprintf (&USBSerialStream, "=RUN,%s,%u,%u,%u,%u,%u,%u,%u,%u\n",
-		profile.name, profile.preheat_temp, profile.soak_dutycycle*5, profile.soak_temp, profile.reflow_time, profile.reflow_temp, profile.calibrated,
-		profile.preheat_cutoff, profile.reflow_cutoff);
+	if (listening == UsbTxHasReader())
+	{
+		return;
+	}
+	UsbTxSetReader(listening);
+	if (listening)
+	{
+		fprintf_P(&USBSerialStream, PSTR("=SYNC,%u\n"), ovenStage);
+	}
 }
 
 //==============================================================================================================================
-//
+// The port was closed, by the program or by the disconnect interrupt. The next reader expects text, so go back to CSV
+// telemetry and forget any **PGET still being sent.
 
-void RunProfileCommand()
+static void HostClosed(void)
 {
-	lcd_gotoxy(0, 1);
-	lcd_puts_P("                ");
-	showTemp = true;
-	ovenStage = 0;
-	count = 0;
-	ProcessHandler = RunProfileHandler;
-	isRunning = true;
-};
+	setTelemetryMode(TELEMETRY_CSV);
+	pgetNext = 0;
+}
 
 //==============================================================================================================================
-//
+// Host commands. Each takes what follows its = (an empty string without one) and returns false if that doesn't parse,
+// ProcessPacket then replies =ERR,<name>.
 
-void RunProfileHandler()
+// Read a number from 0 to 255 ending at a comma or the end of the arguments, and step over it
+static bool ParseByte(char **args, uint8_t *value)
 {
-	switch (ovenStage)
+	char *end;
+	unsigned long n = strtoul(*args, &end, 10);
+
+	if ((end == *args) || (n > 255) || ((*end != ',') && (*end != 0)))
 	{
-		case 0: // close door & start message
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("Close door      ");
-			ovenStage++;
-			break;
+		return false;
+	}
+	*value = n;
+	*args = (*end == ',') ? end + 1 : end;
+	return true;
+}
 
-		case 1: // wait for button press
-			if ((newButton) && (buttons == EVENT_ENTER_BUTTON_PUSHED))
-			{
-				ovenStage++;
-			}
-			break;
+// Read a profile number, 1 to the profile count, that ends the arguments
+static bool ParseProfile(char *args, uint8_t *n)
+{
+	return ((ParseByte(&args, n)) && (*args == 0) && (*n >= 1) && (*n <= eeprom_read_byte(&ProfileCount)));
+}
 
-		case 2: // Preheat
-			printProfile(); // Send the profile we are about to run to the serial port
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("Preheat         ");
-			count = 0;
-			EMR_ON; //Turn on the EMR
-			_delay_ms(25);
-			setDutyCycle(100); //Turn on the SSR
-			ovenStage++;
-			break;
+// =PGET,<n>,<name>,<calibrated>,<preheat temp>,<soak duty>,<soak rate>,<soak time>,<soak temp>,<reflow time>,
+// <reflow temp>,<preheat cutoff>,<reflow cutoff>, the same fields **PSET takes
+static void SendProfile(uint8_t n)
+{
+	__profile p;
+	uint8_t i;
 
-		case 3: // Reached preheat cutoff
-//			if ((ovenTemp >> 2) >= profile.preheat_cutoff)
-			if ((ovenTemp) >= ((profile.preheat_temp << 2) - ovenDelta4))
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("Preheat cutoff  ");
-				setDutyCycle(getDutyCycle(profile.preheat_temp)-5); //Reduce the output power
-				ovenStage++;
-			}
-			break;
+	eeprom_read_block((void*)&p, (const void*)&Profiles[n-1], sizeof(__profile));
+	p.name[PROFILE_NAME_LEN-1] = 0;
+	fprintf_P(&USBSerialStream, PSTR("=PGET,%u,%s"), n, p.name);
+	for (i = 0; i < PROFILE_SETTINGS; i++)
+	{
+		fprintf_P(&USBSerialStream, PSTR(",%u"), (&p.calibrated)[i]);
+	}
+	fputc('\n', &USBSerialStream);
+}
 
-		case 4: // Wait for the oven to reach the preheat temp
-			if ((ovenTemp >> 2) >= profile.preheat_temp)
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts("Soak            ");
-				ovenCounter = 0;
-				ovenStage++;
-			}
-			break;
+// The rest of a **PGET of every profile, a line at a time as the transmit ring makes room for it
+static void SendProfiles(void)
+{
+	if ((pgetNext) && (UsbTxFree() >= PROFILE_REPLY_MAX))
+	{
+		SendProfile(pgetNext);
+		pgetNext = (pgetNext < eeprom_read_byte(&ProfileCount)) ? pgetNext + 1 : 0;
+	}
+}
 
-		case 5:
-			if (tick)
-			{
-				ovenCounter++;
-				ovenError = (int16_t)(ovenTemp-(((uint16_t)(profile.preheat_temp) << 2)+(((uint16_t)profile.soak_temp-(uint16_t)profile.preheat_temp) << 2)*((float)(ovenCounter)/((uint16_t)profile.soak_time << 1))));
-				
-				if (ovenError > 8) // rate to high, reduce duty cycle
-				{
-					setDutyCycle(getDutyCycle(profile.soak_temp));
-				}
-				else
-				{
-					setDutyCycle(getDutyCycle(profile.soak_temp)+abs(ovenError-12)*5/4);
-				}
+static bool CommandBoot(char *args)
+{
+	Bootloader();
+	return true;
+}
 
-				if ((ovenTemp >> 2) >= profile.soak_temp)
-				{
-					setDutyCycle(100);
-					lcd_gotoxy(0, 1);
-					lcd_puts_P("Reflow          ");
-					ovenCounter = count;
-					ovenError = 0;
-					ovenStage++;
-				}
-			}
-/*			else
-			{
-				if ((ovenTemp >> 2) <= profile.preheat_temp)
-				{
-					ovenCounter = count;
-				}
-			} */
-			break;
+static bool CommandOGet(char *args)
+{
+	SendOvenSettings();
+	return true;
+}
 
-		case 6: // Reflow
-//			if ((ovenTemp >> 2) >= profile.reflow_cutoff)
+// **PGET=<n> for one profile, **PGET for =PCOUNT,<count> and then every profile
+static bool CommandPGet(char *args)
+{
+	uint8_t n;
 
-			if ((ovenTemp) >= ((profile.reflow_temp << 2) - (uint16_t)((float)(ovenDelta4)*0.8)))
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("Reflow cutoff ");
-				setDutyCycle(0);
-				ovenStage++;
-			}
-			break;
+	if (*args == 0)
+	{
+		fprintf_P(&USBSerialStream, PSTR("=PCOUNT,%u\n"), eeprom_read_byte(&ProfileCount));
+		pgetNext = 1;
+		return true;
+	}
+	if (!ParseProfile(args, &n))
+	{
+		return false;
+	}
+	SendProfile(n);
+	return true;
+}
 
-		case 7: // Reflow Cutoff
-			if (ovenDelta4 <= 32)
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("Dwell         ");
-				ovenStage++;
-			}
-			break;
+// **PSET=<n>,<name>,<settings as =PGET> writes profile n, one past the last adds a profile. Names are padded with spaces.
+// A profile the stage handlers can run: a soak to divide the ramp by, temperatures that rise from preheat through soak
+// to reflow, and a reflow that stays clear of the over-temperature trip
+static bool ProfileValid(const __profile *p)
+{
+	return ((p->soak_time) && (p->preheat_temp <= p->soak_temp) && (p->soak_temp <= p->reflow_temp) &&
+		(p->reflow_temp <= PROFILE_MAX_TEMP));
+}
 
-		case 8: // Dwell
-			if (tick)
-			{
-				ovenError = (int16_t)(ovenTemp-((uint16_t)(profile.reflow_temp) << 2));
+static bool CommandPSet(char *args)
+{
+	__profile p;
+	uint8_t profiles = eeprom_read_byte(&ProfileCount);
+	uint8_t n;
+	uint8_t i;
+	char *name;
 
-				if (ovenTemp >= (profile.reflow_temp << 2)) // rate to high, reduce duty cycle
-				{
-					setDutyCycle(25);
-				}
-				else
-				{
-					setDutyCycle(getDutyCycle(profile.reflow_temp)-1+abs(ovenError)*5/4);
-				}
-		
-				if ((count-ovenCounter) >= (profile.reflow_time << 1))
-				{
-					lcd_gotoxy(0, 1);
-					lcd_puts_P("Open door    ");
-					setDutyCycle(0); // turn the heat off
-					_delay_ms(25);
-					EMR_OFF;
-					ovenStage++;
-					ovenCounter = 0;
-				}
-			}
-			break;
+	if ((!ParseByte(&args, &n)) || (n < 1) || (n > profiles + 1) || (n > MAX_PROFILES))
+	{
+		return false;
+	}
+	name = args;
+	args = strchr(name, ',');
+	if ((args == NULL) || (args == name) || (args - name > PROFILE_NAME_LEN - 1))
+	{
+		return false;
+	}
+	memset(p.name, ' ', PROFILE_NAME_LEN - 1);
+	memcpy(p.name, name, args - name);
+	p.name[PROFILE_NAME_LEN-1] = 0;
+	args++;
+	for (i = 0; i < PROFILE_SETTINGS; i++)
+	{
+		if (!ParseByte(&args, &(&p.calibrated)[i]))
+		{
+			return false;
+		}
+	}
+	if ((*args) || (!ProfileValid(&p)))
+	{
+		return false;
+	}
 
-		case 9: // Cooldown
-		  if (tick)
-		  {
-				if (ovenCounter < 20)
-				{
-					if (ovenCounter % 2)
-					{
-						PORTD &= ~_BV(7); // Buzzer off
-					}
-					else
-					{
-						PORTD |= _BV(7); // Buzzer on
-					}
-					ovenCounter++;
-				}
-				else
-				{
-					if ((ovenTemp >> 2) < 100)
-					{
-						fprintf(&USBSerialStream, "=END\n");
-						isRunning = false;
-						ovenStage = 0;
-						SetIdleMode();
-					}				
-				}
-		  }				
-			break;
+	eeprom_update_block((const void*)&p, (void*)&Profiles[n-1], sizeof(__profile));
+	if (n > profiles)
+	{
+		eeprom_update_byte(&ProfileCount, n);
 	}
-};
+	if (n == currentProfile)
+	{
+		profile = p;
+	}
+	fprintf_P(&USBSerialStream, PSTR("=PSET,%u\n"), n);
+	return true;
+}
 
-//==============================================================================================================================
-//
+// **PCOUNT=<n> drops the profiles after n, so a host can replace the whole set
+static bool CommandPCount(char *args)
+{
+	uint8_t n;
 
-void SelectProfileCommand()
+	if (!ParseProfile(args, &n))
+	{
+		return false;
+	}
+	eeprom_update_byte(&ProfileCount, n);
+	if (currentProfile > n)
+	{
+		currentProfile = 1;
+		eeprom_read_block((void*)&profile, (const void*)&Profiles[0], sizeof(__profile));
+	}
+	fprintf_P(&USBSerialStream, PSTR("=PCOUNT,%u\n"), n);
+	return true;
+}
+
+// **RUN=<n> runs profile n, **RUN the selected one. The host has loaded the oven and closed the door.
+static bool CommandRun(char *args)
 {
-	currentProfile = CurrentMenuItemIdx;
-	eeprom_read_block ((void*)&profile, (const void*)&Profiles[currentProfile-1], sizeof(__profile));
-};
+	uint8_t n = currentProfile;
 
-//==============================================================================================================================
-//
+	if ((*args) && (!ParseProfile(args, &n)))
+	{
+		return false;
+	}
+	currentProfile = n;
+	eeprom_read_block((void*)&profile, (const void*)&Profiles[n-1], sizeof(__profile));
+	HostStart(RunProfileCommand);
+	return true;
+}
 
-void EditProfileCommand()
+static bool CommandOCal(char *args)
 {
-};
+	HostStart(IdentifyOvenCommand);
+	return true;
+}
 
-//==============================================================================================================================
-//
-	
-void CalibrateOvenCommand()
+static bool CommandATune(char *args)
 {
-	lcd_gotoxy(0, 1);
-	lcd_puts_P("                ");
-	showTemp = true;
-	ovenStage = 0;
-	count = 0;
-	ProcessHandler = CalibrateOvenHandler;
-	isRunning = true;
-};
+	HostStart(AutotuneCommand);
+	return true;
+}
 
-//==============================================================================================================================
-//
-/*
-void CalibrateOvenHandler()
+// The =TRIP and =ABORT lines come from the safety supervisor as it ends the run
+static bool CommandAbort(char *args)
 {
-	switch (ovenStage)
+	if (isRunning)
 	{
-		case 0: // close door & start message
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("Close door     ");
-			ovenStage++;
-			break;
+		SafetyAbort();
+	}
+	else
+	{
+		fputs_P(PSTR("=ABORT\n"), &USBSerialStream);
+	}
+	return true;
+}
 
-		case 1: // wait for button press
-			if ((newButton) && (buttons == EVENT_ENTER_BUTTON_PUSHED))
-			{
-				ovenStage++;
-			}
-			break;
-
-		case 2: // 100%
-			printProfile(); // Send the profile we are about to run to the usb port
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("100%           ");
-			count = 0;
-			EMR_ON; //Turn on the EMR
-			_delay_ms(25);
-			set_duty_cycle(20); //Turn on the SSR at 100%
-			ovenStage++;
-			break;
-
-		case 3: // 50%
-			if ((ovenTemp >> 2) > 140)
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("50%   ");
-				set_duty_cycle(10); //Turn on the SSR at 50%
-				ovenStage++;
-			}
-			break;
-
-		case 4: // 10%
-			if ((ovenTemp >> 2) > 165)
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("10%   ");
-				set_duty_cycle(2); //Turn on the SSR at 10%
-				ovenCounter = 0;
-				ovenStage++;
-			}
-			break;
-
-		case 5: // wait 45 seconds
-		  if (tick)
-		  {
-				if (ovenCounter < 90)
-				{
-					ovenCounter++;
-				}
-				else
-				{
-					ovenStage++;
-				}
-				if ((ovenTemp >> 2) > 175)
-				{
-					lcd_puts_P("0%   ");
-					set_duty_cycle(0);
-				}					
-		  }				
-			break;
-
-		case 6: // Maintain 120c
-			if (tick)
-			{
-				lcd_gotoxy(0, 1);
-				if ((ovenTemp >> 2) >= 181)
-				{
-					lcd_puts_P("0%   ");
-					set_duty_cycle(0); //Turn off the SSR
-				}					
-				else if ((ovenTemp >> 2) >= 180)
-				{
-					lcd_puts_P("10%   ");
-					set_duty_cycle(2); //Turn on the SSR at 10%
-				}
-				else
-				{
-					lcd_puts_P("20%   ");
-					set_duty_cycle(4); //Turn on the SSR at 20%
-				}
-				if (count == 1200)
-				{
-					ovenStage++;
-				}
-			}				
-			break;
-
-		case 7:
-			fprintf(&USBSerialStream, "=END\n");
-			set_duty_cycle(0); //Turn off the SSR
-			_delay_ms(25);
-			EMR_OFF;
-			isRunning = false;
-			ovenStage = 0;
-			SetIdleMode();
-			break;
-	}			
-};
-*/
-
-/*
-void CalibrateOvenHandler()
+// =STATUS,<running>,<stage>,<profile>,<temperature in 0.25c steps>,<duty>
+static bool CommandStatus(char *args)
 {
-	switch (ovenStage)
-	{
-		case 0: // close door & start message
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("Close door     ");
-			ovenStage++;
-			break;
-
-		case 1: // wait for button press
-			if ((newButton) && (buttons == EVENT_ENTER_BUTTON_PUSHED))
-			{
-				ovenStage++;
-			}
-			break;
-
-		case 2: // 10%
-			fprintf (&USBSerialStream, "=OCAL\n");
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("10%            ");
-			count = 0;
-			EMR_ON; //Turn on the EMR
-			_delay_ms(25);
-			set_duty_cycle(2); //Turn on the SSR at 10%
-			ovenStage++;
-			break;
-
-		case 3: // 20%
-			if (count == 480)
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("20%   ");
-				count = 0;
-				set_duty_cycle(4); //Turn on the SSR at 20%
-				ovenStage++;
-			}
-			break;
-
-		case 4: // 30%
-			if (count == 480)
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("30%   ");
-				count = 0;
-				set_duty_cycle(6); //Turn on the SSR at 30%
-				ovenStage++;
-			}
-			break;
-
-		case 5: // 40%
-			if (count == 480)
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("40%   ");
-				count = 0;
-				set_duty_cycle(8); //Turn on the SSR at 40%
-				ovenStage++;
-			}
-			break;
-
-		case 6: // 50%
-			if (count == 480)
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("50%   ");
-				count = 0;
-				set_duty_cycle(10); //Turn on the SSR at 50%
-				ovenStage++;
-			}
-			break;
+	fprintf_P(&USBSerialStream, PSTR("=STATUS,%u,%u,%u,%u,%u\n"), isRunning, ovenStage, currentProfile, ovenTemp, duty_cycle);
+	return true;
+}
 
-		case 7:
-			if (count == 480)
-			{
-				fprintf(&USBSerialStream, "=END\n");
-				set_duty_cycle(0); //Turn off the SSR
-				_delay_ms(25);
-				EMR_OFF;
-				isRunning = false;
-				ovenStage = 0;
-				SetIdleMode();
-			}				
-			break;
-	}			
-};
-*/
-/*
-void CalibrateOvenHandler()
+// **RATE=<Hz>, the control rate (2, 4, 5 or 10), kept in EEPROM
+static bool CommandRate(char *args)
 {
-	switch (ovenStage)
-	{
-		case 0: // close door & start message
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("Close door     ");
-			ovenStage++;
-			break;
+	uint8_t hz;
 
-		case 1: // wait for button press
-			if ((newButton) && (buttons == EVENT_ENTER_BUTTON_PUSHED))
-			{
-				ovenStage++;
-			}
-			break;
-
-		case 2: // 100%
-			fprintf (&USBSerialStream, "=OCAL\n");
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("100%           ");
-			count = 0;
-			EMR_ON; //Turn on the EMR
-			_delay_ms(25);
-			set_duty_cycle(20); //Turn on the SSR at 100%
-			ovenStage++;
-			break;
-
-		case 3:
-			if ((ovenTemp >> 2) >= 250)
-			{
-				set_duty_cycle(0); //Turn off the SSR
-				_delay_ms(25);
-				EMR_OFF;
-				ovenStage++;
-				ovenCounter = 0;
-			}				
-			break;
-			
-		case 4:
-		  if (tick)
-		  {
-				if (ovenCounter < 120)
-				{
-					ovenCounter++;
-				}
-				else
-				{
-					fprintf(&USBSerialStream, "=END\n");
-					isRunning = false;
-					ovenStage = 0;
-					SetIdleMode();
-				}
-		  }				
-			break;
-	}			
-};
-*/
-
-//==============================================================================================================================
-//
-
-uint8_t OCALStageDone(void)
-{
-	if ((ovenDelta32 == 0) && (count >= 600))
-	{
-		deltaCount++;
-		if ((deltaCount == 10) && (!endSet))
-		{
-			endCount = (count >= 1200) ? count+600 : 1800;
-			endSet = 1;
-		}
-	}
-	else
+	if ((!ParseByte(&args, &hz)) || (*args) || (!setControlRate(hz)))
 	{
-		deltaCount = 0;
+		return false;
 	}
-	
-	if (count == endCount)
-	{
-		endCount = 3600;
-		endSet = 0;
-		deltaCount = 0;
-		return 1;
-	}
-	
-	return 0;
+	eeprom_update_byte(&ControlRate, controlRate);
+	fprintf(&USBSerialStream, "=RATE,%u\n", controlRate);
+	return true;
 }
 
-//==============================================================================================================================
-//
-
-void OCALIsDone(void)
+// **TELEM=CSV or **TELEM=BIN, send the temperature packets as CSV lines or binary frames, **TELEM on its own asks which
+static bool CommandTelem(char *args)
 {
-	if (ovenTemp > 1000)
+	if (strcmp_P(args, PSTR("BIN")) == 0)
 	{
-		lcd_gotoxy(0, 1);
-		lcd_puts_P("      ");
-		count = 0;
-		fprintf(&USBSerialStream, "=END\n");
-		setDutyCycle(0); //Turn off the SSR
-		_delay_ms(25);
-		EMR_OFF;
-		isRunning = false;
-		ovenStage = 0;
-		endCount = 3600;
-		endSet = 0;
-		SetIdleMode();
+		setTelemetryMode(TELEMETRY_BINARY);
 	}
-	else
+	else if (strcmp_P(args, PSTR("CSV")) == 0)
 	{
-		setDutyCycle(100); //Turn on the SSR at 100%
-		ovenStage++;
+		setTelemetryMode(TELEMETRY_CSV);
 	}
-
-}
-
-//==============================================================================================================================
-//
-
-void CalibrateOvenHandler()
-{
-	if (ovenTemp > 1080)
+	else if (*args)
 	{
-		fprintf(&USBSerialStream, "=END\n");
-		setDutyCycle(0); //Turn off the SSR
-		_delay_ms(25);
-		EMR_OFF;
-		isRunning = false;
-		ovenStage = 0;
-		endCount = 3600;
-		endSet = 0;
-		SetIdleMode();
-		return;
+		return false;
 	}
-	
-	switch (ovenStage)
-	{
-		case 0: // close door & start message
-			lcd_gotoxy(0, 0);
-			lcd_puts_P("Oven Cal ");
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("Close door     ");
-			ovenStage++;
-			break;
-
-		case 1: // wait for button press
-			if ((newButton) && (buttons == EVENT_ENTER_BUTTON_PUSHED))
-			{
-				ovenStage++;
-			}
-			break;
-
-		case 2: // start 5%
-			fprintf (&USBSerialStream, "=OCAL\n");
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("5%            ");
-			count = 0;
-			EMR_ON; //Turn on the EMR
-			_delay_ms(25);
-			setDutyCycle(100); //Turn on the SSR at 100%
-			endCount = 3600;
-			endSet = 0;
-			ovenStage++;
-			break;
-
-		case 3: // to 5%
-			if ((duty_cycle == 100) && (ovenDelta4 >= 63))
-			{
-				setDutyCycle(5); //Turn on the SSR at 5%
-			}
-			if (OCALStageDone())
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("10%   ");
-				count = 0;
-				OCALIsDone();
-			}
-			break;
-
-		case 4: // to 10%
-			if ((duty_cycle == 100) && (ovenDelta4 >= 63))
-//			if (count == 50)
-			{
-				setDutyCycle(10); //Turn on the SSR at 10%
-			}
-			if (OCALStageDone())
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("15%   ");
-				count = 0;
-				OCALIsDone();
-			}
-			break;
-			
-		case 5: // to 15%
-			if ((duty_cycle == 100) && (ovenDelta4 >= 63))
-//			if (count == 45)
-			{
-				setDutyCycle(15); //Turn on the SSR at 15%
-			}
-			if (OCALStageDone())
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("20%   ");
-				count = 0;
-				OCALIsDone();
-			}
-			break;
-
-		case 6: // to 20%
-			if ((duty_cycle == 100) && (ovenDelta4 >= 63))
-//			if (count == 40)
-			{
-				setDutyCycle(20); //Turn on the SSR at 20%
-			}
-			if (OCALStageDone())
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("25%   ");
-				count = 0;
-				OCALIsDone();
-			}
-			break;
-			
-		case 7: // to 25%
-			if ((duty_cycle == 100) && (ovenDelta4 >= 63))
-//			if (count == 40)
-			{
-				setDutyCycle(25); //Turn on the SSR at 25%
-			}
-			if (OCALStageDone())
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("30%   ");
-				count = 0;
-				OCALIsDone();
-			}
-			break;
-
-		case 8: // to 30%
-			if ((duty_cycle == 100) && (ovenDelta4 >= 63))
-//			if (count == 40)
-			{
-				setDutyCycle(30); //Turn on the SSR at 30%
-			}
-			if (OCALStageDone())
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("35%   ");
-				count = 0;
-				OCALIsDone();
-			}
-			break;
-
-		case 9: // to 35%
-			if ((duty_cycle == 100) && (ovenDelta4 >= 63))
-//			if (count == 40)
-			{
-				setDutyCycle(35); //Turn on the SSR at 35%
-			}
-			if (OCALStageDone())
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("40%   ");
-				count = 0;
-				OCALIsDone();
-			}
-			break;
-
-		case 10: // to 40%
-			if ((duty_cycle == 100) && (ovenDelta4 >= 63))
-//			if (count == 40)
-			{
-				setDutyCycle(40); //Turn on the SSR at 40%
-			}
-			if (OCALStageDone())
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("45%   ");
-				count = 0;
-				OCALIsDone();
-			}
-			break;
-
-		case 11: // to 45%
-			if ((duty_cycle == 100) && (ovenDelta4 >= 63))
-//			if (count == 40)
-			{
-				setDutyCycle(45); //Turn on the SSR at 45%
-			}
-			if (OCALStageDone())
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("50%   ");
-				count = 0;
-				OCALIsDone();
-			}
-			break;
-
-		case 12: // to 50%
-			if ((duty_cycle == 100) && (ovenDelta4 >= 63))
-//			if (count == 40)
-			{
-				setDutyCycle(50); //Turn on the SSR at 50%
-			}
-			if (OCALStageDone())
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("      ");
-				count = 0;
-				fprintf(&USBSerialStream, "=END\n");
-				setDutyCycle(0); //Turn off the SSR
-				_delay_ms(25);
-				EMR_OFF;
-				isRunning = false;
-				ovenStage = 0;
-				endCount = 3600;
-				endSet = 0;
-				SetIdleMode();
-			}
-			break;
-	}			
-};
-
-//==============================================================================================================================
-//
-	
-void PIDTestCommand()
-{
-	lcd_gotoxy(0, 1);
-	lcd_puts_P("                ");
-	showTemp = true;
-	ovenStage = 0;
-	count = 0;
-	
-/*
-	pid.Kp = 0.75;  // 7.0 == oscillate a bit
-	pid.Ki = 0.0; // 0.003; // 0.03;
-	pid.Kd = 0.0; // 1.0; // 42;
-	pid.limMin = 0.0;
-	pid.limMax = 100.0;
-	pid.limMinInt = -1.0;
-	pid.limMaxInt = 1.0;
-	pid.T = 0.5;
-	pid.tau = 90.0;
-*/
-	pid.Kp = 2;  // 7.0 == oscillate a bit
-	pid.Ki = 0.0; // 0.003; // 0.03;
-	pid.Kd = 0.0; // 1.0; // 42;
-	pid.limMin = 0.0;
-	pid.limMax = 10.0;
-	pid.limMinInt = -1.0;
-	pid.limMaxInt = 1.0;
-	pid.T = 0.5;
-	pid.tau = 90.0;
-	
-	PIDController_Init(&pid);
-	
-	ProcessHandler = PIDTestHandler;
-	isRunning = true;
-};
-
-//==============================================================================================================================
-//
-
-void PIDTestHandler()
-{
-	if (ovenTemp > 1080)
-	{
-		fprintf(&USBSerialStream, "=END\n");
-		setDutyCycle(0); //Turn off the SSR
-		_delay_ms(25);
-		EMR_OFF;
-		isRunning = false;
-		ovenStage = 0;
-		SetIdleMode();
-		return;
-	}
-
-	switch (ovenStage)
-	{
-		case 0: // close door & start message
-			lcd_gotoxy(0, 0);
-			lcd_puts_P("PID Test");
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("             ");
-			fprintf (&USBSerialStream, "=OPIDTEST\n");
-			EMR_ON; //Turn on the EMR
-			_delay_ms(25);
-			ovenStage = 3;
-			break;
-			
-		case 3:
-			if (tick)
-			{
-				PIDController_Update(&pid, 60, ovenTemp);
-//				fprintf_P (&USBSerialStream, PSTR("#,%.2f,%.2f,%.2f\n"), pid.proportional, pid.integrator, pid.differentiator);
-				ovenError = pid.prevError;
-				setDutyCycle(pid.out);
-			}
-			break;
-	}
-};
-
-//==============================================================================================================================
-//
+	fprintf(&USBSerialStream, "=TELEM,%s\n", (telemetryMode == TELEMETRY_BINARY) ? "BIN" : "CSV");
+	return true;
+}
 
-void CalibrateProfileCommand()
+static bool CommandStats(char *args)
 {
-};
-
-//==============================================================================================================================
-//
+	SendLoopStats();
+	return true;
+}
 
-void Calibrate60cCommand()
+static bool CommandTasks(char *args)
 {
-	lcd_gotoxy(0, 1);
-	lcd_puts_P("                ");
-	showTemp = true;
-	ovenStage = 0;
-	count = 0;
-	ProcessHandler = Calibrate60cHandler;
-	isRunning = true;
-};
-
-//==============================================================================================================================
-//
+	SchedulerReport(&USBSerialStream);
+	return true;
+}
 
-void Calibrate60cHandler()
+static bool CommandTxStats(char *args)
 {
-	if (ovenTemp > 1080)
-	{
-		fprintf(&USBSerialStream, "=END\n");
-		setDutyCycle(0); //Turn off the SSR
-		_delay_ms(25);
-		EMR_OFF;
-		isRunning = false;
-		ovenStage = 0;
-		SetIdleMode();
-		return;
-	}
-	
-	switch (ovenStage)
-	{
-		case 0: // close door & start message
-			lcd_gotoxy(0, 0);
-			lcd_puts_P("Oven 60c");
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("Close door     ");
-			ovenStage++;
-			break;
-
-		case 1: // wait for button press
-			if ((newButton) && (buttons == EVENT_ENTER_BUTTON_PUSHED))
-			{
-				ovenStage++;
-			}
-			break;
-
-		case 2: // start 20%
-			fprintf (&USBSerialStream, "=O60\n");
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("20%           ");
-			count = 0;
-			EMR_ON; //Turn on the EMR
-			_delay_ms(25);
-			setDutyCycle(20); //Turn on the SSR at 20%
-			ovenStage++;
-			break;
-		
-		case 3: // to 50c
-			if (ovenTemp >= 200) //50c
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("5% @50c    ");
-				endCount = count;
-				setDutyCycle(5); //Turn on the SSR at 5%
-				ovenStage++;
-			}
-			break;
-
-		case 4: // to 60c
-			if (ovenTemp >= 240) //60c
-			{
-				setDutyCycle(0); //Turn off the SSR
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("60c cutoff");
-				endCount = count-endCount;
-				ovenEndTemp = ovenTemp;
-				ovenStage++;
-			}
-			break;
+	UsbTxReport(&USBSerialStream);
+	return true;
+}
 
-		case 5: // wait for delta4 to get to 0
-			if (ovenDelta4 <= 0)
-			{
-				EMR_OFF;
-				isRunning = false;
-				ovenStage = 0;
-				fprintf(&USBSerialStream, "=END\n");
-				SetIdleMode();
-			}
-			break;
-	}
+const char CmdBoot[] PROGMEM = "BOOT";
+const char CmdOGet[] PROGMEM = "OGET";
+const char CmdPGet[] PROGMEM = "PGET";
+const char CmdPSet[] PROGMEM = "PSET";
+const char CmdPCount[] PROGMEM = "PCOUNT";
+const char CmdRun[] PROGMEM = "RUN";
+const char CmdOCal[] PROGMEM = "OCAL";
+const char CmdATune[] PROGMEM = "ATUNE";
+const char CmdAbort[] PROGMEM = "ABORT";
+const char CmdStatus[] PROGMEM = "STATUS";
+const char CmdRate[] PROGMEM = "RATE";
+const char CmdTelem[] PROGMEM = "TELEM";
+const char CmdStats[] PROGMEM = "STATS";
+const char CmdTasks[] PROGMEM = "TASKS";
+const char CmdTxStats[] PROGMEM = "TXSTATS";
+
+const COMMAND Commands[] PROGMEM =
+{
+	{CmdBoot, COMMAND_IDLE, CommandBoot},					// Enter the bootloader
+	{CmdOGet, 0, CommandOGet},										// Oven settings
+	{CmdPGet, 0, CommandPGet},										// One profile or all of them
+	{CmdPSet, COMMAND_IDLE, CommandPSet},					// Write a profile
+	{CmdPCount, COMMAND_IDLE, CommandPCount},			// Drop profiles off the end
+	{CmdRun, COMMAND_IDLE, CommandRun},						// Run a profile
+	{CmdOCal, COMMAND_IDLE, CommandOCal},					// Calibrate the oven
+	{CmdATune, COMMAND_IDLE, CommandATune},				// Autotune the PID gains
+	{CmdAbort, 0, CommandAbort},									// End the run with the heater off
+	{CmdStatus, 0, CommandStatus},								// Running, stage, profile, temperature and duty
+	{CmdRate, COMMAND_IDLE, CommandRate},					// Control rate
+	{CmdTelem, 0, CommandTelem},									// Telemetry format
+	{CmdStats, 0, CommandStats},									// Main loop overrun counters
+	{CmdTasks, 0, CommandTasks},									// Main loop task timings
+	{CmdTxStats, 0, CommandTxStats}								// USB transmit ring counters
 };
 
 //==============================================================================================================================
-//
+// Process a packet from the PC application. A command is ** and a name from Commands, with =<arguments> for those that
+// take them. An unknown command or bad arguments get =ERR,<name>, and one that needs the oven idle gets =BUSY,<name>
+// during a run or the splash screen. Anything not starting with ** is ignored.
 
-void Calibrate120cCommand()
+void ProcessPacket(char* packet)
 {
-	lcd_gotoxy(0, 1);
-	lcd_puts_P("                ");
-	showTemp = true;
-	ovenStage = 0;
-	count = 0;
-	ProcessHandler = Calibrate120cHandler;
-	isRunning = true;
-};
+	COMMAND command;
+	uint8_t i;
+	uint8_t length;
+	char *name = packet + 2;
 
-//==============================================================================================================================
-//
+	HostListening(true); // A program that doesn't raise DTR is listening once it sends a command
 
-void Calibrate120cHandler()
-{
-	if (ovenTemp > 1080)
+	if ((packet[0] != '*') || (packet[1] != '*'))
 	{
-		fprintf(&USBSerialStream, "=END\n");
-		setDutyCycle(0); //Turn off the SSR
-		_delay_ms(25);
-		EMR_OFF;
-		isRunning = false;
-		ovenStage = 0;
-		SetIdleMode();
 		return;
 	}
-	
-	switch (ovenStage)
-	{
-		case 0: // close door & start message
-			lcd_gotoxy(0, 0);
-			lcd_puts_P("Oven 120c");
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("Close door     ");
-			ovenStage++;
-			break;
-
-		case 1: // wait for button press
-			if ((newButton) && (buttons == EVENT_ENTER_BUTTON_PUSHED))
-			{
-				ovenStage++;
-			}
-			break;
-
-		case 2: // start 100%
-			fprintf (&USBSerialStream, "=O120\n");
-			lcd_gotoxy(0, 1);
-			lcd_puts_P("100%          ");
-			count = 0;
-			EMR_ON; //Turn on the EMR
-			_delay_ms(25);
-			setDutyCycle(20); //Turn on the SSR at 20%
-			ovenStage++;
-			break;
-			
-		case 3: // to 100c
-			if (ovenTemp >= 400) //100c
-			{
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("100% @100c    ");
-				endCount = count;
-				ovenStage++;
-			}
-			break;			
 
-		case 4: // to 120c
-			if (ovenTemp >= 480) //120c
+	for (i = 0; i < sizeof(Commands) / sizeof(COMMAND); i++)
+	{
+		memcpy_P(&command, &Commands[i], sizeof(COMMAND));
+		length = strlen_P(command.Name);
+		if ((strncmp_P(name, command.Name, length) == 0) && ((name[length] == 0) || (name[length] == '=')))
+		{
+			if ((command.Flags & COMMAND_IDLE) && ((isRunning) || (!ready)))
 			{
-				setDutyCycle(0); //Turn off the SSR
-				lcd_gotoxy(0, 1);
-				lcd_puts_P("120c cutoff");
-				endCount = count-endCount;
-				ovenEndTemp = ovenTemp;
-				ovenStage++;
+				fprintf_P(&USBSerialStream, PSTR("=BUSY,%S\n"), command.Name);
 			}
-			break;
-
-		case 5: // wait for delta4 to get to 0
-			if (ovenDelta4 <= 0)
+			else if (!command.Run(name + length + (name[length] == '=')))
 			{
-				EMR_OFF;
-				isRunning = false;
-				ovenStage = 0;
-				fprintf(&USBSerialStream, "=END\n");
-				SetIdleMode();
+				fprintf_P(&USBSerialStream, PSTR("=ERR,%S\n"), command.Name);
 			}
-			break;
+			return;
+		}
 	}
-};
-
-//==============================================================================================================================
-// Produce a short beep
-
-void keybeep (void)
-{
-	PORTD |= _BV(7);
-	_delay_ms (10);
-	PORTD &= ~_BV(7);
+	fprintf_P(&USBSerialStream, PSTR("=ERR,%s\n"), name);
 }
 
 //==============================================================================================================================
-// Process a packet from the PC application
+// Take the next press or repeat from the debounced button queue, following the releases on the way. buttons is left
+// holding every button that is down.
 
-void ProcessPacket(char* packet)
+uint8_t ReadButtons()
 {
-	if (strcmp(packet, "**BOOT") == 0) // Command to enter the bootloader
-	{
-		Bootloader();
-	}
-	else if (strcmp(packet, "**OGET") == 0) // Command to get oven parameters
-	{
-		SendOvenSettings();
-	}
-	else if (strcmp(packet, "**PGET=") == 0) // Command to get oven parameters
-	{
-	}
-	else if (strcmp(packet, "**OCAL") == 0) // Command to calibrate oven
-	{
-	}
-	else if (strcmp(packet, "**PCAL=") == 0) // Command to calibrate profile
+	uint8_t event;
+
+	while ((event = ButtonsGetEvent()) != 0)
 	{
-	}
-}
+		switch (event & BUTTON_TYPE_MASK)
+		{
+			case BUTTON_RELEASE:
+				buttons &= ~(event & BUTTON_MASK);
+				break;
 
-//==============================================================================================================================
-// Read the front panel buttons
+			case BUTTON_PRESS:
+				buttons |= event & BUTTON_MASK;
+				return buttons;
 
-uint8_t ReadButtons()
-{
-	uint8_t tmpb;
-		
-	tmpb = (~PINC >> 4) & 0x0F;
-		
-	if (tmpb == buttons)
-	{
-		return 0;
+			case BUTTON_REPEAT:
+				return buttons;
+		}
 	}
-  buttons = tmpb;
-  if (buttons)
-  {
-		keybeep();
-  }		
-	return buttons;
+	return 0;
 }
 
 //==============================================================================================================================
@@ -1658,10 +788,14 @@ void IdleDisplayEventHandler(uint8_t Event)
 
 int main(void)
 {
+	uint8_t splash = 0;
+
 	SetupHardware();
 	
-	// Create a regular character stream for the interface so that it can be used with the stdio.h functions
-	CDC_Device_CreateStream(&VirtualSerial_CDC_Interface, &USBSerialStream);
+	// Create a write only character stream for the interface so that it can be used with the stdio.h functions, writes go
+	// through the transmit ring and commands are read by UsbRxGetLine
+	UsbTxInit(&VirtualSerial_CDC_Interface, &USBSerialStream);
+	UsbRxInit(&VirtualSerial_CDC_Interface);
 
 	sei();
 
@@ -1673,7 +807,7 @@ int main(void)
 
 	for (;;)
 	{
-		if (tick == 6)
+		if ((splash == 0) && (GetUptime() >= 3000))
 		{
 			if (lcdPresent)
 			{
@@ -1696,26 +830,20 @@ int main(void)
 					lcd_gotoxy(0, 1);
 					lcd_puts(tmpStr);
 				}
-				tick++;
 			}
+			splash++;
 		}
-		else if (tick == 13)		
+		else if ((splash == 1) && (GetUptime() >= 6500))
 		{
 			if (lcdPresent)
 			{
 			  lcd_clrscr(); // clear display and home cursor
 			}
-			tick = 0;
+			FlushEvents(); // Nothing has been taking events during the splash
 			break;
 		}
 		
-		if (GetPacket(inBuf, sizeof(inBuf))) // Check if there is incoming USB data
-		{
-			ProcessPacket(inBuf);
-		}
-		
-		CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
-		USB_USBTask();
+		UsbTask();
 	}
 
 	// Load the default profile
@@ -1723,57 +851,72 @@ int main(void)
 	
 	SetIdleMode();
 
+	SchedulerInit(tasks, sizeof(tasks) / sizeof(TASK));
+	ready = true;
 	for (;;)
 	{
-		if ((newButton = ReadButtons()))
-		{
-			if ((buttons == EVENT_MENU_BUTTON_PUSHED) && (isRunning)) // Turn the oven off and go back to idle
-			{ 
-				setDutyCycle(0); //Turn off the SSR
-				_delay_ms(25);
-				EMR_OFF; //Turn off the EMR
-				fprintf(&USBSerialStream, "=ABORT\n");
-				isRunning = false;
-				ovenStage = 0;
-				SetIdleMode();
-			}
-			else if ((buttons != 0) && (!isRunning) && (lcdPresent)) // Only allow the use of menus if there is an LCD
-			{
-				MenuExecuteEvent(buttons);
-			}
-		}
-		
-		if (readtick)
-		{
-			if (readings < 4)
-			{
-				ovenTempAccum += ReadTemp();
-				readings++;
-			}
-			readtick = 0;
-		}
+		SchedulerPass();
+	}
+}
 
-		if (isRunning)
-		{
-			(*ProcessHandler)();
-		}
+//==============================================================================================================================
+// Front panel task, reads the buttons and handles abort and the menus
 
-		if (tick)
-		{
-			UpdateTemp();
-			tick = 0;
-			readings = 0;
-		}
-		
-		if (GetPacket(inBuf, sizeof(inBuf))) // Check if there is incoming USB data
-		{
-			ProcessPacket(inBuf);
-		}
+void PanelTask(void)
+{
+	newButton = ReadButtons();
+	if ((newButton) && (buttons == EVENT_MENU_BUTTON_PUSHED) && (isRunning)) // Turn the oven off and go back to idle
+	{
+		SafetyAbort(); // The pin change has normally beaten us to it
+	}
+
+	if (SafetyService()) // A trip has ended the run, the button that caused it is used up
+	{
+		newButton = 0;
+	}
+	else if ((newButton) && (buttons != 0) && (!isRunning) && (lcdPresent)) // Only allow the use of menus if there is an LCD
+	{
+		MenuExecuteEvent(buttons);
+	}
+}
+
+//==============================================================================================================================
+// Control task, runs for timer events and for a new button while a stage handler is active
 
-		CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
-		USB_USBTask();
-		_delay_ms(10);
+bool ControlReady(void)
+{
+	return (ControlPending() || ((newButton) && (isRunning)));
+}
+
+void ControlRun(void)
+{
+	ControlTask();
+	newButton = 0; // The handler has seen it, don't run again for the same press
+}
+
+//==============================================================================================================================
+// USB task, takes commands from the PC and services the endpoints
+
+void UsbTask(void)
+{
+	static bool reader = false;
+	bool present = UsbTxHasReader(); // Read once, the disconnect interrupt can clear it at any time
+
+	if ((reader) && (!present))
+	{
+		HostClosed();
 	}
+	reader = present;
+
+	if (UsbRxGetLine(inBuf, sizeof(inBuf))) // Check if there is incoming USB data
+	{
+		ProcessPacket(inBuf);
+	}
+
+	SendProfiles();
+	UsbTxDrain();
+	CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
+	USB_USBTask();
 }
 
 //==============================================================================================================================
@@ -19,41 +19,44 @@
 #define MAX_PROFILES			16
 #define PROFILE_NAME_LEN	17
 
+// COMMAND.Flags
+#define COMMAND_IDLE			0x01	// Refused during a run
+
+//==============================================================================================================================
+// Typedefs
+
+// Host command, see ProcessPacket
+typedef struct
+{
+	PGM_P Name;							// Without the leading **
+	uint8_t Flags;					// COMMAND_ flags
+	bool (*Run)(char*);			// Given what follows the = (or an empty string), false for bad arguments
+} COMMAND;
+
 //==============================================================================================================================
 // Function Prototypes
 
 	void MenuGetEEMEMItem(uint8_t);
-	uint8_t GetPacket(char*, uint8_t);
 	void SetupHardware(void);
-	void UpdateTemp(void);
 	void SendOvenSettings(void);
 	void Bootloader(void);
-	void setDutyCycle (uint8_t);
-	uint8_t getDutyCycle(uint16_t);
-	void printProfile (void);
-	void RunProfileCommand(void);
-	void RunProfileHandler(void);
 	void SelectProfileCommand(void);
 	void EditProfileCommand(void);
-	void CalibrateOvenCommand(void);
-	void CalibrateOvenHandler(void);
-	void PIDTestCommand(void);
-	void PIDTestHandler(void);
 	void CalibrateProfileCommand(void);
-	void Calibrate60cCommand(void);
-	void Calibrate60cHandler(void);
-	void Calibrate120cCommand(void);
-	void Calibrate120cHandler(void);
-	void keybeep (void);
 	void ProcessPacket(char*);
 	uint8_t ReadButtons(void);
 	void EVENT_USB_Device_Connect(void);
 	void EVENT_USB_Device_Disconnect(void);
 	void EVENT_USB_Device_ConfigurationChanged(void);
 	void EVENT_USB_Device_ControlRequest(void);
+	void HostListening(bool);
 	void Bootloader(void);
 	void SetIdleMode(void);
 	void IdleDisplayEventHandler(uint8_t);
+	void PanelTask(void);
+	bool ControlReady(void);
+	void ControlRun(void);
+	void UsbTask(void);
 
 #endif
 
@@ -0,0 +1,165 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "ButtonCheck.c"
+// Title 			: Front panel button checks
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+//
+// Drives buttons.c the way the pin change and timer interrupts do, bouncing the switches on PINC, and checks the events
+// it queues: one press or release per settled change, nothing for a glitch, UP and DOWN repeating on their own after
+// BUTTON_REPEAT_DELAY slots, and the queue keeping the oldest events when nobody reads it. The exit status is 1 if any
+// check failed.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "hal.h"
+
+#include "menu.h"
+#include "buttons.h"
+#include "check.h"
+
+//==============================================================================================================================
+// Hardware stand-ins used by buttons.c and buzzer.c
+
+volatile uint8_t PORTD = 0;
+volatile uint8_t PINC = 0xF0;	// Buttons pulled up
+
+//==============================================================================================================================
+// Functions
+
+// Run the timer slot, then count and discard the events that turned up
+static uint8_t Slots(uint16_t n)
+{
+	uint8_t events = 0;
+
+	while (n--)
+	{
+		ButtonsSlot();
+		while (ButtonsGetEvent())
+		{
+			events++;
+		}
+	}
+	return events;
+}
+
+// Change a switch, the pin change interrupt follows the edge
+static void Pin(uint8_t button, bool down)
+{
+	if (down)
+	{
+		PINC &= ~(button << 4);
+	}
+	else
+	{
+		PINC |= (button << 4);
+	}
+	ButtonsEdge();
+}
+
+// Bounce a switch for a few slots, ending in the given state
+static void Bounce(uint8_t button, bool down)
+{
+	for (uint8_t i = 0; i < 5; i++)
+	{
+		Pin(button, (i & 1) ? down : !down);
+		ButtonsSlot();
+	}
+	Pin(button, down);
+}
+
+// Slots until the next event, 0xFFFF for none within the limit
+static uint16_t SlotsToEvent(uint16_t limit, uint8_t *event)
+{
+	for (uint16_t n = 1; n <= limit; n++)
+	{
+		ButtonsSlot();
+		if ((*event = ButtonsGetEvent()) != 0)
+		{
+			return n;
+		}
+	}
+	*event = 0;
+	return 0xFFFF;
+}
+
+//==============================================================================================================================
+// The check entry point
+
+int main(void)
+{
+	uint8_t event;
+	uint16_t n;
+
+	// Nothing happens with the switches left alone
+	Check("idle", Slots(200), 0);
+
+	// A bouncing press is one press, BUTTON_DEBOUNCE_SLOTS after the last edge, and starts the key click
+	Bounce(EVENT_ENTER_BUTTON_PUSHED, true);
+	n = SlotsToEvent(20, &event);
+	Check("press debounce slots", n, BUTTON_DEBOUNCE_SLOTS);
+	Check("press", event, BUTTON_PRESS | EVENT_ENTER_BUTTON_PUSHED);
+	Check("key click", PORTD & _BV(PD7), _BV(PD7));
+	Check("single press", ButtonsGetEvent(), 0);
+
+	// ENTER held doesn't repeat
+	Check("ENTER held", Slots(200), 0);
+
+	// A bouncing release is one release
+	Bounce(EVENT_ENTER_BUTTON_PUSHED, false);
+	n = SlotsToEvent(20, &event);
+	Check("release debounce slots", n, BUTTON_DEBOUNCE_SLOTS);
+	Check("release", event, BUTTON_RELEASE | EVENT_ENTER_BUTTON_PUSHED);
+	Check("single release", ButtonsGetEvent(), 0);
+
+	// A glitch that settles back where it started is nothing
+	Bounce(EVENT_MENU_BUTTON_PUSHED, false);
+	Check("glitch", Slots(20), 0);
+
+	// UP held repeats after BUTTON_REPEAT_DELAY, then every BUTTON_REPEAT_SLOTS
+	Pin(EVENT_UP_BUTTON_PUSHED, true);
+	n = SlotsToEvent(20, &event);
+	Check("UP press", event, BUTTON_PRESS | EVENT_UP_BUTTON_PUSHED);
+	n = SlotsToEvent(200, &event);
+	Check("repeat delay", n, BUTTON_REPEAT_DELAY);
+	Check("UP repeat", event, BUTTON_REPEAT | EVENT_UP_BUTTON_PUSHED);
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		n = SlotsToEvent(200, &event);
+		Check("repeat slots", n, BUTTON_REPEAT_SLOTS);
+		Check("UP repeat", event, BUTTON_REPEAT | EVENT_UP_BUTTON_PUSHED);
+	}
+
+	// DOWN as well stops the repeat, letting it go again starts the hold delay over
+	Pin(EVENT_DOWN_BUTTON_PUSHED, true);
+	n = SlotsToEvent(20, &event);
+	Check("DOWN press", event, BUTTON_PRESS | EVENT_DOWN_BUTTON_PUSHED);
+	Check("UP and DOWN held", Slots(200), 0);
+	Pin(EVENT_DOWN_BUTTON_PUSHED, false);
+	n = SlotsToEvent(20, &event);
+	Check("DOWN release", event, BUTTON_RELEASE | EVENT_DOWN_BUTTON_PUSHED);
+	n = SlotsToEvent(200, &event);
+	Check("repeat delay again", n, BUTTON_REPEAT_DELAY);
+
+	// Nobody reading: the queue keeps the oldest events and drops the new ones
+	Pin(EVENT_UP_BUTTON_PUSHED, false);
+	Slots(20);
+	Pin(EVENT_UP_BUTTON_PUSHED, true);
+	for (uint16_t i = 0; i < 400; i++)
+	{
+		ButtonsSlot();
+	}
+	Check("queue oldest", ButtonsGetEvent(), BUTTON_PRESS | EVENT_UP_BUTTON_PUSHED);
+	for (n = 1; ButtonsGetEvent() == (BUTTON_REPEAT | EVENT_UP_BUTTON_PUSHED); n++)
+	{
+	}
+	Check("queue depth", n, 8);
+
+	return CheckDone("buttons");
+}
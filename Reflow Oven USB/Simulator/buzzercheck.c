@@ -0,0 +1,195 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "BuzzerCheck.c"
+// Title 			: Buzzer pattern checks
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+//
+// Steps buzzer.c through the timer slots, recording D.7, and checks each pattern sounds for the slots it should, that a
+// pattern only gives way to one of the same or higher priority, that BuzzerStop silences it at once and that D.7 is put
+// back every slot if something else writes port D. The exit status is 1 if any check failed.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "hal.h"
+
+#include "buzzer.h"
+#include "check.h"
+
+//==============================================================================================================================
+// Defines
+
+#define MAX_RUNS				128
+#define QUIET_SLOTS			200			// Quiet this long and the pattern has finished
+
+//==============================================================================================================================
+// Hardware stand-ins used by buzzer.c
+
+volatile uint8_t PORTD = 0;
+
+//==============================================================================================================================
+// Functions
+
+static bool Sounding(void)
+{
+	return (PORTD & _BV(PD7)) != 0;
+}
+
+// Slots the buzzer spends in each state from now until it has been quiet for QUIET_SLOTS, starting with the state it is
+// in. The trailing quiet isn't counted.
+static uint8_t Timeline(uint16_t *runs)
+{
+	uint8_t n = 0;
+	bool on = Sounding();
+	uint16_t length = 1;
+
+	for (;;)
+	{
+		BuzzerSlot();
+		if (Sounding() == on)
+		{
+			length++;
+			if ((!on) && (length >= QUIET_SLOTS))
+			{
+				return n;
+			}
+			continue;
+		}
+		if (n < MAX_RUNS)
+		{
+			runs[n++] = length;
+		}
+		on = !on;
+		length = 1;
+	}
+}
+
+// A pattern of beeps, on and off in slots, played a number of times with the last gap left off
+static uint8_t Expected(uint16_t *runs, const uint16_t *beeps, uint8_t steps, uint8_t repeat)
+{
+	uint8_t n = 0;
+
+	while (repeat--)
+	{
+		for (uint8_t i = 0; i < steps; i++)
+		{
+			runs[n++] = beeps[i];
+		}
+	}
+	return n - 1;
+}
+
+static void CheckTimeline(const char *what, const uint16_t *want, uint8_t wantRuns)
+{
+	uint16_t got[MAX_RUNS];
+	uint8_t n = Timeline(got);
+	uint8_t i;
+
+	Check(what, n, wantRuns);
+	for (i = 0; (i < n) && (i < wantRuns); i++)
+	{
+		if (got[i] != want[i])
+		{
+			fprintf(stderr, "  run %u\n", i);
+			Check(what, got[i], want[i]);
+			return;
+		}
+	}
+}
+
+static void Settle(void)
+{
+	for (uint16_t i = 0; i < QUIET_SLOTS; i++)
+	{
+		BuzzerSlot();
+	}
+}
+
+//==============================================================================================================================
+// The check entry point
+
+int main(void)
+{
+	static const uint16_t key[] = {1, 0};
+	static const uint16_t runEnd[] = {50, 50};
+	static const uint16_t fault[] = {10, 10, 10, 10, 10, 60};
+	uint16_t want[MAX_RUNS];
+	uint8_t n;
+
+	// Quiet until asked
+	Settle();
+	Check("idle", Sounding(), false);
+
+	// Key click, one slot
+	BuzzerPlay(BEEP_KEY);
+	n = Expected(want, key, 2, 1);
+	CheckTimeline("key click", want, n);
+
+	// Run end, half second beeps for ten seconds
+	BuzzerPlay(BEEP_RUN_END);
+	n = Expected(want, runEnd, 2, 10);
+	CheckTimeline("run end", want, n);
+
+	// Fault, three quick beeps and a gap five times over
+	BuzzerPlay(BEEP_FAULT);
+	n = Expected(want, fault, 6, 5);
+	CheckTimeline("fault", want, n);
+
+	// A key click doesn't cut short the run end, which carries on as if it hadn't happened
+	BuzzerPlay(BEEP_RUN_END);
+	for (uint8_t i = 0; i < 20; i++)
+	{
+		BuzzerSlot();
+	}
+	BuzzerPlay(BEEP_KEY);
+	n = Expected(want, runEnd, 2, 10);
+	want[0] -= 20;
+	CheckTimeline("key during run end", want, n);
+
+	// A fault replaces the run end from its first beep
+	BuzzerPlay(BEEP_RUN_END);
+	for (uint8_t i = 0; i < 70; i++)
+	{
+		BuzzerSlot();
+	}
+	BuzzerPlay(BEEP_FAULT);
+	n = Expected(want, fault, 6, 5);
+	CheckTimeline("fault during run end", want, n);
+
+	// The run end doesn't replace a fault, a second fault starts it over
+	BuzzerPlay(BEEP_FAULT);
+	for (uint8_t i = 0; i < 5; i++)
+	{
+		BuzzerSlot();
+	}
+	BuzzerPlay(BEEP_RUN_END);
+	BuzzerPlay(BEEP_FAULT);
+	n = Expected(want, fault, 6, 5);
+	CheckTimeline("fault restarted", want, n);
+
+	// Stop is immediate
+	BuzzerPlay(BEEP_FAULT);
+	BuzzerSlot();
+	BuzzerStop();
+	Check("stop", Sounding(), false);
+	BuzzerSlot();
+	Check("stopped", Sounding(), false);
+
+	// Port D written behind the buzzer's back is put right in the next slot
+	BuzzerPlay(BEEP_RUN_END);
+	PORTD &= ~_BV(PD7);
+	BuzzerSlot();
+	Check("restored on", Sounding(), true);
+	BuzzerStop();
+	PORTD |= _BV(PD7);
+	BuzzerSlot();
+	Check("restored off", Sounding(), false);
+
+	return CheckDone("buzzer");
+}
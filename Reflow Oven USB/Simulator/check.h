@@ -0,0 +1,53 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Check.h"
+// Title 			: Shared pass and fail counting for the check programs
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+//
+// Each check program includes this once, after hal.h, and ends main with return CheckDone("name").
+
+
+#ifndef CHECK_H_
+#define CHECK_H_
+
+//==============================================================================================================================
+// Private variables
+
+static uint16_t checks = 0;
+static uint16_t failed = 0;
+
+//==============================================================================================================================
+// Inline Functions
+
+// Count a check, returns ok so the caller can say what went wrong
+static inline bool Passed(bool ok)
+{
+	checks++;
+	if (!ok)
+	{
+		failed++;
+	}
+	return ok;
+}
+
+static inline void Check(const char *what, long got, long want)
+{
+	if (!Passed(got == want))
+	{
+		fprintf(stderr, "FAIL %s: got %ld (0x%02lX), want %ld (0x%02lX)\n", what, got, got, want, want);
+	}
+}
+
+// Print the tally, the exit status is 1 if anything failed
+static inline int CheckDone(const char *name)
+{
+	fprintf(stderr, "%s: %u checks, %u failed\n", name, checks, failed);
+	return failed != 0;
+}
+
+#endif /* CHECK_H_ */
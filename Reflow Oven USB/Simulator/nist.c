@@ -0,0 +1,105 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Nist.c"
+// Title 			: NIST ITS-90 type K reference functions
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+//
+// Coefficients are from NIST Monograph 175. Used to model what the MAX31855 reports and to build and check the
+// firmware linearisation table (see typekgen.c).
+
+
+//==============================================================================================================================
+// Includes
+
+#include <math.h>
+
+#include "nist.h"
+
+//==============================================================================================================================
+// Defines
+
+#define MAX31855_SEEBECK	0.041276	// mV/C the converter assumes
+
+//==============================================================================================================================
+// Coefficients
+
+// Temperature (C) to EMF (mV), -270c to 0c
+static const double nistForwardNeg[] =
+{
+	0.0, 0.394501280250E-01, 0.236223735980E-04, -0.328589067840E-06, -0.499048287770E-08, -0.675090591730E-10,
+	-0.574103274280E-12, -0.310888728940E-14, -0.104516093650E-16, -0.198892668780E-19, -0.163226974860E-22
+};
+
+// Temperature (C) to EMF (mV), 0c to 1372c, plus the exponential term
+static const double nistForwardPos[] =
+{
+	-0.176004136860E-01, 0.389212049750E-01, 0.185587700320E-04, -0.994575928740E-07, 0.318409457190E-09,
+	-0.560728448890E-12, 0.560750590590E-15, -0.320207200030E-18, 0.971511471520E-22, -0.121047212750E-25
+};
+static const double nistExp[] = {0.118597600000E+00, -0.118343200000E-03, 0.126968600000E+03};
+
+// EMF (mV) to temperature (C), -5.891mV to 0mV
+static const double nistInverseNeg[] =
+{
+	0.0, 2.5173462E+01, -1.1662878E+00, -1.0833638E+00, -8.9773540E-01, -3.7342377E-01, -8.6632643E-02,
+	-1.0450598E-02, -5.1920577E-04
+};
+
+// EMF (mV) to temperature (C), 0mV to 20.644mV
+static const double nistInversePos[] =
+{
+	0.0, 2.508355E+01, 7.860106E-02, -2.503131E-01, 8.315270E-02, -1.228034E-02, 9.804036E-04, -4.413030E-05,
+	1.057734E-06, -1.052755E-08
+};
+
+//==============================================================================================================================
+// Evaluate a polynomial, lowest order coefficient first
+
+static double Poly(const double *c, int n, double x)
+{
+	double y = 0;
+
+	while (n--)
+	{
+		y = y * x + c[n];
+	}
+	return y;
+}
+
+//==============================================================================================================================
+// Thermocouple EMF (mV) with the reference junction at 0c
+
+double NistTypeKVoltage(double t)
+{
+	if (t < 0)
+	{
+		return Poly(nistForwardNeg, sizeof(nistForwardNeg) / sizeof(double), t);
+	}
+	return Poly(nistForwardPos, sizeof(nistForwardPos) / sizeof(double), t) +
+		nistExp[0] * exp(nistExp[1] * (t - nistExp[2]) * (t - nistExp[2]));
+}
+
+//==============================================================================================================================
+// Temperature (C) for a thermocouple EMF (mV) with the reference junction at 0c, valid -200c to 500c
+
+double NistTypeKTemp(double mv)
+{
+	if (mv < 0)
+	{
+		return Poly(nistInverseNeg, sizeof(nistInverseNeg) / sizeof(double), mv);
+	}
+	return Poly(nistInversePos, sizeof(nistInversePos) / sizeof(double), mv);
+}
+
+//==============================================================================================================================
+// Temperature (C) the MAX31855 reports for a hot junction at t with its cold junction at junction
+
+double NistMax31855Reading(double t, double junction)
+{
+	return junction + (NistTypeKVoltage(t) - NistTypeKVoltage(junction)) / MAX31855_SEEBECK;
+}
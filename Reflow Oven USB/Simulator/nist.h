@@ -0,0 +1,23 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Nist.h"
+// Title 			: NIST ITS-90 type K reference functions
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+
+
+#ifndef NIST_H_
+#define NIST_H_
+
+//==============================================================================================================================
+// Function Prototypes
+
+double NistTypeKVoltage(double);
+double NistTypeKTemp(double);
+double NistMax31855Reading(double, double);
+
+#endif /* NIST_H_ */
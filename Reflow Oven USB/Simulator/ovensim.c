@@ -0,0 +1,560 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "OvenSim.c"
+// Title 			: Host simulator for the oven control core
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+//
+// Builds control.c and pid.c for the host (see hal.h) and runs them against the thermal model in thermal.c. Each
+// simulated 10ms timer slot advances the model, calls the TIMER1 compare vector and makes one pass of the control loop,
+// so a complete profile takes a few milliseconds instead of several minutes.
+//
+// Usage: ovensim [-m run|ocal|ident|pid|60|120|tune|mains] [-p profile] [-a ambient] [-j cold junction] [-w watts]
+//                [-n noise] [-l liquidus] [-t seconds] [-k abort seconds] [-f open TC seconds] [-r control Hz]
+//                [-s stall ms] [-z mains Hz] [-x] [-b] [-o telemetry file] [-q] [-v] [-h]
+//
+// The USB telemetry stream goes to stdout (or -o file, -q discards it) and a one line summary goes to stderr. -b sends
+// the temperature packets as binary frames, as after **TELEM=BIN.
+//
+// -k presses MENU and -f opens the thermocouple at the given time, to exercise the safety supervisor. The exit status
+// is 3 if the relays were ever switched out of order.
+//
+// -z models the mains and a zero-cross SSR and feeds the zero-cross input a pulse at each crossing, -x leaves the
+// detector out. Mode mains steps the duty from 0% to 100% and reports how far the half cycles delivered stray from it.
+
+
+//==============================================================================================================================
+// Includes
+
+#include <math.h>
+#include <unistd.h>
+
+#include "hal.h"
+
+#include "ReflowOven.h"
+#include "control.h"
+#include "lcd.h"
+#include "spi.h"
+#include "typek.h"
+#include "menu.h"
+#include "thermal.h"
+#include "nist.h"
+#include "telemetry.h"
+
+//==============================================================================================================================
+// Defines
+
+#define SLOT_TIME				0.01		// Seconds per TIMER1 compare interrupt
+#define DOOR_DELAY			2.0			// Seconds before the simulated operator presses ENTER
+#define SIM_QUEUE_LEN		8				// Same depth as the SPI sample queue on the target
+#define RELAY_SETTLE		0.025		// Seconds the EMR contacts take to open or close
+#define SPI_FRAME_COUNTS	4				// Timer1 counts to clock in a frame, four bytes at 4MHz and their interrupts
+
+//==============================================================================================================================
+// Hardware stand-ins used by the control core
+
+volatile uint8_t PORTB = _BV(OVEN_RELAY_EMR);
+volatile uint8_t PORTD = 0;
+volatile uint8_t PINB = 0;
+volatile uint8_t PINC = 0xF0;	// Buttons pulled up
+volatile uint16_t TCNT1 = 0;
+volatile uint8_t TIFR1 = 0;
+FILE *hal_usb_stream;
+volatile uint8_t spiOverruns = 0;
+bool lcdPresent = true;
+uint8_t buttons = 0;
+uint8_t newButton = 0;
+
+//==============================================================================================================================
+// Private variables
+
+static THERMAL_MODEL oven;
+static double simTime = 0;
+static double noise = 0;
+static double openTime = 0;				// Thermocouple goes open circuit from here, 0 for never
+static double junction = 0;
+static bool verbose = false;
+static bool idle = false;
+static uint8_t lcdX, lcdY;
+static char lcdLine[LCD_LINES][LCD_DISP_LENGTH + 1];
+static SPI_SAMPLE spiQueue[SIM_QUEUE_LEN];
+static uint8_t spiQueueHead, spiQueueTail;
+static uint16_t stallSlots = 0;		// Main loop blocked for this long once a second
+
+static double peakTemp = 0;
+static double peakTime = 0;
+static double liquidus = 217.0;
+static double timeAboveLiquidus = 0;
+static double maxRise = 0;
+static double lastSecondTemp = 0;
+
+static double mainsHz = 0;				// 0 runs the SSR straight off the pin
+static double mainsPhase = 0.0037;	// First zero crossing, deliberately off the timer grid
+static bool detector = true;
+static double mainsNext;
+static bool conducting = false;
+static uint32_t halfCycles, halfCyclesOn;
+
+static bool emrClosed = false;
+static bool ssrOn = false;
+static double emrChanged = -1.0;
+static uint32_t relayFaults = 0;	// EMR switched with the SSR on, or SSR on before the EMR settled
+
+//==============================================================================================================================
+// Check the relay ordering the firmware promises, at the start of each slot
+
+static void SimCheckRelays(void)
+{
+	bool emr = !(PORTB & _BV(OVEN_RELAY_EMR));
+	bool ssr = (PORTB & _BV(OVEN_RELAY_SSR)) != 0;
+
+	if (emr != emrClosed)
+	{
+		if ((ssr) || (ssrOn))
+		{
+			relayFaults++;
+		}
+		emrClosed = emr;
+		emrChanged = simTime;
+	}
+	if ((ssr) && (!ssrOn) && (simTime - emrChanged < RELAY_SETTLE - 1e-9))
+	{
+		relayFaults++;
+	}
+	ssrOn = ssr;
+}
+
+//==============================================================================================================================
+// Advance the simulation by one timer slot
+
+static void SimSlot(void)
+{
+	double t = simTime;
+	double end = simTime + SLOT_TIME;
+
+	SimCheckRelays();
+
+	if (mainsHz > 0)
+	{
+		// A zero-cross SSR, it only changes state at a zero crossing and then conducts for the whole half cycle
+		while (mainsNext < end)
+		{
+			ThermalStep(&oven, conducting ? 1.0 : 0.0, mainsNext - t);
+			t = mainsNext;
+			if (detector)
+			{
+				TCNT1 = (uint16_t)((t - simTime) / SLOT_TIME * TIMER1_PERIOD);
+				PINB |= _BV(ZERO_CROSS_PIN);
+				PCINT0_vect();
+				PINB &= ~_BV(ZERO_CROSS_PIN);
+				PCINT0_vect();
+			}
+			conducting = (PORTB & _BV(OVEN_RELAY_SSR)) && !(PORTB & _BV(OVEN_RELAY_EMR));
+			halfCycles++;
+			halfCyclesOn += conducting;
+			mainsNext += 0.5 / mainsHz;
+		}
+		ThermalStep(&oven, conducting ? 1.0 : 0.0, end - t);
+	}
+	else
+	{
+		bool heating = (PORTB & _BV(OVEN_RELAY_SSR)) && !(PORTB & _BV(OVEN_RELAY_EMR));
+
+		ThermalStep(&oven, heating ? 1.0 : 0.0, SLOT_TIME);
+	}
+	simTime = end;
+
+	if (oven.Oven > peakTemp)
+	{
+		peakTemp = oven.Oven;
+		peakTime = simTime;
+	}
+	if (oven.Oven >= liquidus)
+	{
+		timeAboveLiquidus += SLOT_TIME;
+	}
+	if (fmod(simTime + SLOT_TIME / 2, 1.0) < SLOT_TIME)
+	{
+		if (oven.Oven - lastSecondTemp > maxRise)
+		{
+			maxRise = oven.Oven - lastSecondTemp;
+		}
+		lastSecondTemp = oven.Oven;
+	}
+
+	TIMER1_COMPA_vect();
+}
+
+//==============================================================================================================================
+// Busy waits in the control core let time (and the timer interrupt) run on
+
+void hal_delay_ms(uint16_t ms)
+{
+	for (uint16_t i = 0; i < ms; i += 10)
+	{
+		SimSlot();
+	}
+}
+
+//==============================================================================================================================
+// MAX31855 reading of the simulated thermocouple, including the error of its straight line type K conversion
+
+static void SimReadSensor(SPI_SAMPLE *sample)
+{
+	double t = oven.Sensor;
+
+	if (noise > 0)
+	{
+		// Box-Muller, good enough for sensor noise
+		double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+		double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+		t += noise * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+	}
+	if (t < 0)
+	{
+		t = 0;
+	}
+	sample->Value = (uint16_t)lround(NistMax31855Reading(t, junction) * 4.0);
+	sample->Junction = (int16_t)lround(junction * 16.0);
+	sample->Faults = 0;
+	if ((openTime > 0) && (simTime >= openTime))
+	{
+		sample->Value = 65535;
+		sample->Faults = SPI_FAULT_OC | SPI_FAULT_ANY;
+	}
+}
+
+//==============================================================================================================================
+// The SPI transfer takes microseconds, so a started frame is complete by the time the main loop looks for it. The
+// safety check sees it SPI_FRAME_COUNTS after it was started.
+
+void spi_start(void)
+{
+	SPI_SAMPLE sample;
+	uint32_t start = TimerNow();
+
+	SimReadSensor(&sample);
+	sample.Time = (uint32_t)lround(simTime * 125000.0);
+	TCNT1 += SPI_FRAME_COUNTS;
+	SafetyCheckSample(&sample, start);
+	TCNT1 -= SPI_FRAME_COUNTS;
+
+	if ((uint8_t)(spiQueueHead - spiQueueTail) < SIM_QUEUE_LEN)
+	{
+		spiQueue[spiQueueHead++ % SIM_QUEUE_LEN] = sample;
+	}
+	else
+	{
+		spiOverruns++;
+	}
+}
+
+uint8_t spi_get_sample(SPI_SAMPLE *sample, uint32_t before)
+{
+	if (spiQueueTail == spiQueueHead)
+	{
+		return 0;
+	}
+	if ((int32_t)(spiQueue[spiQueueTail % SIM_QUEUE_LEN].Time - before) >= 0)
+	{
+		return 0;
+	}
+	*sample = spiQueue[spiQueueTail++ % SIM_QUEUE_LEN];
+	sample->Value = spi_temperature(sample);
+	return 1;
+}
+
+uint16_t spi_temperature(const SPI_SAMPLE *sample)
+{
+	if (!sample->Faults) // As the firmware, a fault code goes through as it is
+	{
+		return TypeKLinearise(sample->Value, sample->Junction);
+	}
+	return sample->Value;
+}
+
+//==============================================================================================================================
+// LCD, only the status line is of interest
+
+void lcd_clrscr(void)
+{
+	memset(lcdLine, 0, sizeof(lcdLine));
+	lcdX = 0;
+	lcdY = 0;
+}
+
+void lcd_gotoxy(uint8_t x, uint8_t y)
+{
+	lcdX = x;
+	lcdY = y;
+}
+
+void lcd_puts(const char *s)
+{
+	for (; *s; s++)
+	{
+		if (*s == '\n')
+		{
+			lcdX = 0;
+			lcdY = (lcdY + 1) % LCD_LINES;
+		}
+		else if (lcdX < LCD_DISP_LENGTH)
+		{
+			lcdLine[lcdY][lcdX++] = *s;
+		}
+	}
+	if (lcdY == 1)
+	{
+		// The operator opens the door when asked to and closes it when a new run starts
+		oven.DoorOpen = (strncmp(lcdLine[1], "Open door", 9) == 0);
+	}
+	if ((verbose) && (lcdY == 1))
+	{
+		fprintf(stderr, "%8.2f  %5.1fc  %s\n", simTime, oven.Oven, lcdLine[1]);
+	}
+}
+
+void lcd_puts_p(const char *s)
+{
+	lcd_puts(s);
+}
+
+//==============================================================================================================================
+// The stage handlers drop back to idle mode when they finish
+
+void SetIdleMode(void)
+{
+	idle = true;
+}
+
+//==============================================================================================================================
+// Step the duty in quarter percents and compare the half cycles the SSR conducted with it
+
+static int SimMainsSweep(void)
+{
+	double worst = 0;
+	uint16_t duty;
+
+	if (mainsHz <= 0)
+	{
+		fprintf(stderr, "mode mains needs -z\n");
+		return 1;
+	}
+
+	HeaterOn();
+	for (duty = 0; duty <= 400; duty++)
+	{
+		THERMAL_PARAMS params = oven.Params;
+
+		ThermalInit(&oven, &params); // Back to ambient, hours at high duty would trip the over-temperature cut out
+		setDutyCycleFine(duty << 6);
+		for (uint16_t i = 0; i < 100; i++)
+		{
+			SimSlot();
+		}
+		halfCycles = 0;
+		halfCyclesOn = 0;
+		for (uint16_t i = 0; i < 1000; i++)
+		{
+			SimSlot();
+		}
+
+		double error = 100.0 * halfCyclesOn / halfCycles - duty / 4.0;
+		if (fabs(error) > fabs(worst))
+		{
+			worst = error;
+		}
+		if (verbose)
+		{
+			fprintf(stderr, "%6.2f%%  %6.2f%%\n", duty / 4.0, 100.0 * halfCyclesOn / halfCycles);
+		}
+	}
+
+	fprintf(stderr, "mains %.1fHz, detector %s, locked at %uHz: worst power error %+.2f%% over 10s\n",
+		mainsHz, detector ? "fitted" : "absent", getMainsFrequency(), worst);
+
+	return 0;
+}
+
+//==============================================================================================================================
+// The simulator entry point
+
+int main(int argc, char *argv[])
+{
+	THERMAL_PARAMS params = ThermalDefaults;
+	const char *mode = "run";
+	uint8_t profileIdx = 1;
+	double timeLimit = 3600.0;
+	double abortTime = 0;
+	bool pressed = false;
+	bool junctionSet = false;
+	int opt;
+
+	hal_usb_stream = stdout;
+
+	while ((opt = getopt(argc, argv, "m:p:a:j:w:n:l:t:k:f:r:s:z:o:xbqvh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'm': mode = optarg; break;
+			case 'p': profileIdx = atoi(optarg); break;
+			case 'a': params.Ambient = atof(optarg); break;
+			case 'j': junction = atof(optarg); junctionSet = true; break;
+			case 'w': params.Power = atof(optarg); break;
+			case 'n': noise = atof(optarg); break;
+			case 'l': liquidus = atof(optarg); break;
+			case 't': timeLimit = atof(optarg); break;
+			case 'k': abortTime = atof(optarg); break;
+			case 'f': openTime = atof(optarg); break;
+			case 'r':
+				if (!setControlRate(atoi(optarg)))
+				{
+					fprintf(stderr, "control rate must be 2, 4, 5 or 10\n");
+					return 1;
+				}
+				break;
+			case 's':
+				stallSlots = atoi(optarg) / 10;
+				if (stallSlots >= 100)
+				{
+					fprintf(stderr, "stall must be under a second\n");
+					return 1;
+				}
+				break;
+			case 'z': mainsHz = atof(optarg); break;
+			case 'x': detector = false; break;
+			case 'b': setTelemetryMode(TELEMETRY_BINARY); break;
+			case 'o':
+				if ((hal_usb_stream = fopen(optarg, "w")) == NULL)
+				{
+					perror(optarg);
+					return 1;
+				}
+				break;
+			case 'q': hal_usb_stream = fopen("/dev/null", "w"); break;
+			case 'v': verbose = true; break;
+			case 'h':
+			default:
+				// -h asked for it, anything else is a mistake
+				fprintf((opt == 'h') ? stdout : stderr, "usage: %s [-m run|ocal|ident|pid|60|120|tune|mains] [-p profile] [-a ambient] [-j junction] "
+					"[-w watts] [-n noise] [-l liquidus] [-t seconds] [-k abort seconds] [-f open TC seconds] [-r control Hz] [-s stall ms] [-z mains Hz] [-x] [-b] [-o file] [-q] [-v] [-h]\n", argv[0]);
+				return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if ((profileIdx < 1) || (profileIdx > eeprom_read_byte(&ProfileCount)))
+	{
+		fprintf(stderr, "profile %u is not defined\n", profileIdx);
+		return 1;
+	}
+
+	if (!junctionSet)
+	{
+		junction = params.Ambient; // Controller box at room temperature
+	}
+	ThermalInit(&oven, &params);
+	mainsNext = mainsPhase;
+	lastSecondTemp = oven.Oven;
+	eeprom_read_block((void*)&profile, (const void*)&Profiles[profileIdx-1], sizeof(__profile));
+
+	if (strcmp(mode, "mains") == 0)
+	{
+		return SimMainsSweep();
+	}
+	else if (strcmp(mode, "run") == 0)
+	{
+		RunProfileCommand();
+	}
+	else if (strcmp(mode, "ocal") == 0)
+	{
+		CalibrateOvenCommand();
+	}
+	else if (strcmp(mode, "pid") == 0)
+	{
+		PIDTestCommand();
+	}
+	else if (strcmp(mode, "60") == 0)
+	{
+		Calibrate60cCommand();
+	}
+	else if (strcmp(mode, "120") == 0)
+	{
+		Calibrate120cCommand();
+	}
+	else if (strcmp(mode, "ident") == 0)
+	{
+		IdentifyOvenCommand();
+	}
+	else if (strcmp(mode, "tune") == 0)
+	{
+		AutotuneCommand();
+	}
+	else
+	{
+		fprintf(stderr, "unknown mode %s\n", mode);
+		return 1;
+	}
+
+	// A second of the timer running before the run starts, cleared the way the splash screen clears it on the target
+	for (uint8_t i = 0; i < 100; i++)
+	{
+		SimSlot();
+	}
+	FlushEvents();
+
+	while ((!idle) && (simTime < timeLimit))
+	{
+		buttons = 0;
+		newButton = 0;
+		if ((!pressed) && (ovenStage == 1) && (simTime >= DOOR_DELAY))
+		{
+			buttons = EVENT_ENTER_BUTTON_PUSHED;
+			newButton = buttons;
+			pressed = true;
+		}
+		if ((abortTime > 0) && (simTime >= abortTime) && (PINC & _BV(ABORT_PIN)))
+		{
+			bool ssr = (PORTB & _BV(OVEN_RELAY_SSR)) != 0;
+
+			PINC &= ~_BV(ABORT_PIN); // MENU pressed and held
+			PCINT1_vect();
+			fprintf(stderr, "MENU at %.2fs: SSR was %s, now %s\n", simTime, ssr ? "on" : "off",
+				(PORTB & _BV(OVEN_RELAY_SSR)) ? "on" : "off");
+		}
+
+		SafetyService();
+		ControlTask();
+		SimSlot();
+
+		if ((stallSlots) && (fmod(simTime + SLOT_TIME / 2, 1.0) < SLOT_TIME))
+		{
+			// Blocked on the USB stream or the LCD, the timer keeps queueing events
+			for (uint16_t i = 0; i < stallSlots; i++)
+			{
+				SimSlot();
+			}
+		}
+	}
+
+	fflush(hal_usb_stream);
+	fprintf(stderr, "%s profile %u: %s after %.1fs, peak %.1fc at %.1fs, %.1fs above %.0fc, max rise %.2fc/s\n",
+		mode, profileIdx, idle ? "finished" : "stopped", simTime, peakTemp, peakTime, timeAboveLiquidus, liquidus, maxRise);
+	if (stallSlots)
+	{
+		fprintf(stderr, "main loop stalled %ums a second: %u events and %u samples dropped, up to %u events waiting, %u ticks\n",
+			stallSlots * 10, eventOverruns, spiOverruns, eventDepthMax, count);
+	}
+
+	if (relayFaults)
+	{
+		fprintf(stderr, "relay sequencing broken %u times\n", relayFaults);
+		return 3;
+	}
+	return idle ? 0 : 2;
+}
+
+//==============================================================================================================================
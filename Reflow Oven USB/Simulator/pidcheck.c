@@ -0,0 +1,234 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "PidCheck.c"
+// Title 			: Fixed point PID and soak ramp checks
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+//
+// Runs pid.c and the float controller in pidfloat.c side by side over the gains the firmware has used, at each control
+// rate, with the setpoint and oven temperature wandering over the full input range and the feedforward the control loop
+// adds. Then works every soak setpoint SoakSetpoint can give against the float ramp it replaced. The coefficients
+// PIDController_Init works out are checked to be within a Q16 step of the float ones and then handed to the float
+// controller, so what is compared is the arithmetic: the output is truncated to whole counts from both, and may come out
+// one count apart but never further. The exit status is 1 if any check failed.
+
+
+//==============================================================================================================================
+// Includes
+
+#include <math.h>
+
+#include "hal.h"
+
+#include "ReflowOven.h"
+#include "control.h"
+#include "pid.h"
+#include "pidfloat.h"
+#include "check.h"
+
+//==============================================================================================================================
+// Defines
+
+#define RUNS						200			// Walks per gain set and rate
+#define STEPS						600			// Control ticks per walk
+#define TEMP_MAX				(1100 << 2)		// Top of the input range, 0.25c
+
+//==============================================================================================================================
+// Hardware stand-ins used by control.h
+
+volatile uint16_t TCNT1 = 0;
+volatile uint8_t TIFR1 = 0;
+volatile uint32_t timerBase = 0;
+
+//==============================================================================================================================
+// Private variables
+
+typedef struct
+{
+	double Kp, Ki, Kd, limMin, limMax, limMinInt, limMaxInt, tau;
+} GAINS;
+
+static const GAINS gains[] =
+{
+	{2.0, 0.0, 0.0, 0.0, 10.0, -1.0, 1.0, 90.0},					// Cal60
+	{0.75, 0.0, 0.0, 0.0, 100.0, -1.0, 1.0, 90.0},				// PIDTest
+	{2.0, 0.003, 1.0, 0.0, 100.0, -20.0, 20.0, 90.0},			// PIDTest, commented out
+	{7.0, 0.03, 42.0, 0.0, 100.0, -50.0, 50.0, 90.0},			// PIDTest, "oscillate a bit"
+	{1.5, 0.01, 5.0, 0.0, 100.0, -30.0, 30.0, 10.0},			// A relay tuned set
+	{5.0, 0.1, 100.0, 0.0, 100.0, -20.0, 20.0, 10.0},			// PidParams as shipped
+};
+
+static const uint8_t rates[] = {2, 4, 5, 10};
+
+static uint32_t seed = 1;
+
+//==============================================================================================================================
+// Functions
+
+// The same walk on every host, whatever its rand()
+static uint16_t Random(uint16_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (uint16_t)(seed >> 16) % n;
+}
+
+static uint16_t Walk(int32_t x, uint8_t step)
+{
+	x += (int32_t)Random(2 * step + 1) - step;
+	return (x < 0) ? 0 : (x > TEMP_MAX) ? TEMP_MAX : x;
+}
+
+// Q16 steps between a fixed point coefficient and the float one
+static double Step(int32_t q, float f)
+{
+	return fabs(q - f * 65536.0);
+}
+
+// Differences between the two controllers for one gain set at one rate, worst one in *worst
+static uint32_t PidRuns(const GAINS *g, uint8_t rate, uint32_t *updates, uint16_t *worst, bool *coefficients)
+{
+	uint32_t differ = 0;
+
+	for (uint16_t run = 0; run < RUNS; run++)
+	{
+		PIDController q = {0};
+		PIDFloat f = {0};
+		uint16_t setpoint = Random(TEMP_MAX + 1);
+		uint16_t temp = Random(TEMP_MAX + 1);
+
+		q.Kp = PID_Q16(g->Kp);
+		q.Ki = PID_Q16(g->Ki);
+		q.Kd = PID_Q16(g->Kd);
+		q.limMin = PID_Q16(g->limMin);
+		q.limMax = PID_Q16(g->limMax);
+		q.limMinInt = PID_Q16(g->limMinInt);
+		q.limMaxInt = PID_Q16(g->limMaxInt);
+		q.T = PID_Q16(1.0) / rate;
+		q.tau = PID_Q16(g->tau);
+		PIDController_Init(&q);
+
+		// The float one gets the gains the Q16 one actually has
+		f.Kp = q.Kp / 65536.0;
+		f.Ki = q.Ki / 65536.0;
+		f.Kd = q.Kd / 65536.0;
+		f.limMin = g->limMin;
+		f.limMax = g->limMax;
+		f.limMinInt = g->limMinInt;
+		f.limMaxInt = g->limMaxInt;
+		f.T = q.T / 65536.0;
+		f.tau = q.tau / 65536.0;
+		PIDFloat_Init(&f);
+
+		// Each coefficient rounds to within a Q16 step, the float one then uses the same ones so only the arithmetic is compared
+		*coefficients |= (Step(q.kiT, f.kiT) > 1) || (Step(q.kdD, f.kdD) > 1) || (Step(q.alpha, f.alpha) > 1);
+		f.kiT = q.kiT / 65536.0;
+		f.kdD = q.kdD / 65536.0;
+		f.alpha = q.alpha / 65536.0;
+		f.limP = q.limP;
+		f.limI = q.limI;
+		f.limD = q.limD;
+
+		for (uint16_t i = 0; i < STEPS; i++)
+		{
+			uint16_t a, b;
+
+			// The oven drifts a few quarter degrees a tick, the setpoint ramps or steps to a new stage
+			temp = Walk(temp, 8);
+			setpoint = (Random(100) == 0) ? Random(TEMP_MAX + 1) : Walk(setpoint, 2);
+			q.ff = (int32_t)Random((uint16_t)g->limMax + 1) << 16;
+			f.ff = q.ff / 65536.0;
+
+			a = PIDController_Update(&q, setpoint, temp);
+			b = PIDFloat_Update(&f, setpoint, temp);
+			(*updates)++;
+			if (a != b)
+			{
+				uint16_t d = (a > b) ? a - b : b - a;
+
+				differ++;
+				if (d > *worst)
+				{
+					*worst = d;
+				}
+			}
+		}
+	}
+	return differ;
+}
+
+// The float ramp RunSoak used before SoakSetpoint
+static uint16_t SoakFloat(uint8_t preheat, uint8_t soak, uint16_t n, uint16_t ticks)
+{
+	return ((uint16_t)preheat << 2) + (uint16_t)((((uint16_t)soak - preheat) << 2) * ((float)n / ticks));
+}
+
+//==============================================================================================================================
+// The check entry point
+
+int main(void)
+{
+	uint32_t updates = 0, differ = 0, ramps = 0, rampDiffer = 0;
+	uint16_t worst = 0, rampWorst = 0;
+	char what[48];
+
+	for (uint8_t s = 0; s < sizeof(gains) / sizeof(gains[0]); s++)
+	{
+		for (uint8_t r = 0; r < sizeof(rates); r++)
+		{
+			uint16_t w = 0;
+			bool coefficients = false;
+
+			differ += PidRuns(&gains[s], rates[r], &updates, &w, &coefficients);
+			sprintf(what, "gain set %u at %uHz coefficients", s + 1, rates[r]);
+			Check(what, coefficients, false);
+			sprintf(what, "gain set %u at %uHz within a count", s + 1, rates[r]);
+			Check(what, w <= 1, true);
+			if (w > worst)
+			{
+				worst = w;
+			}
+		}
+	}
+
+	// Every soak the profile editor allows, ramping up or holding, at every rate and every tick of the soak
+	for (uint16_t preheat = 0; preheat <= PROFILE_MAX_TEMP; preheat += 5)
+	{
+		for (uint16_t soak = preheat; soak <= PROFILE_MAX_TEMP; soak += 5)
+		{
+			for (uint16_t time = 1; time <= 255; time += 6)
+			{
+				for (uint8_t r = 0; r < sizeof(rates); r++)
+				{
+					uint16_t ticks = time * rates[r];
+
+					for (uint16_t n = 0; n <= ticks; n++)
+					{
+						uint16_t a = SoakSetpoint(preheat, soak, n, ticks);
+						uint16_t b = SoakFloat(preheat, soak, n, ticks);
+						uint16_t d = (a > b) ? a - b : b - a;
+
+						ramps++;
+						if (d)
+						{
+							rampDiffer++;
+							if (d > rampWorst)
+							{
+								rampWorst = d;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	Check("soak ramp within a count", rampWorst <= 1, true);
+	Check("soak ramp ends on the soak temp", SoakSetpoint(150, 180, 120, 120), 180 << 2);
+
+	printf("pid: %u updates, %u differ by one count, worst %u\n", updates, differ, worst);
+	printf("soak: %u setpoints, %u differ by one count, worst %u\n", ramps, rampDiffer, rampWorst);
+	return CheckDone("pid");
+}
@@ -0,0 +1,116 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "PidFloat.c"
+// Title 			: Float reference for the fixed point PID controller
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+//
+// The float controller pid.c started from, carried forward with the changes the fixed point one has had since: setpoint
+// and measurement both in 0.25c steps, the derivative taken on the error, the inputs to each term limited so that no
+// term passes TERM_MAX, and the feedforward added before the output limits. pidcheck.c runs it alongside pid.c.
+
+
+//==============================================================================================================================
+// Includes
+
+#include <stdint.h>
+
+#include "pidfloat.h"
+
+//==============================================================================================================================
+// Defines
+
+#define TERM_MAX				8192.0f		// PID_TERM_MAX in output units
+
+//==============================================================================================================================
+// Functions
+
+static float Clamp(float x, float lim)
+{
+	if (x > lim)
+	{
+		return lim;
+	}
+	else if (x < -lim)
+	{
+		return -lim;
+	}
+	return x;
+}
+
+// Largest input that keeps gain * input inside TERM_MAX, as a whole number of 0.25c steps
+static float Limit(float gain)
+{
+	if (gain < 0.0f)
+	{
+		gain = -gain;
+	}
+	if (gain <= TERM_MAX / INT16_MAX)
+	{
+		return INT16_MAX;
+	}
+	return (float)(int32_t)(TERM_MAX / gain);
+}
+
+void PIDFloat_Init(PIDFloat *pid)
+{
+	pid->kiT = pid->Ki * pid->T / 2.0f;
+	pid->kdD = 2.0f * pid->Kd / (2.0f * pid->tau + pid->T);
+	pid->alpha = (2.0f * pid->tau - pid->T) / (2.0f * pid->tau + pid->T);
+
+	pid->limP = Limit(pid->Kp);
+	pid->limI = Limit(pid->kiT);
+	pid->limD = Limit(pid->kdD);
+
+	pid->integrator = 0.0f;
+	pid->prevError = 0.0f;
+	pid->differentiator = 0.0f;
+	pid->ff = 0.0f;
+	pid->out = 0;
+}
+
+uint16_t PIDFloat_Update(PIDFloat *pid, uint16_t setpoint, uint16_t measurement)
+{
+	float error = (float)setpoint - (float)measurement;
+	float result;
+
+	// Proportional
+	pid->proportional = pid->Kp * Clamp(error, pid->limP);
+
+	// Integral, clamped against wind-up
+	pid->integrator = pid->integrator + pid->kiT * Clamp(error + pid->prevError, pid->limI);
+	if (pid->integrator > pid->limMaxInt)
+	{
+		pid->integrator = pid->limMaxInt;
+	}
+	else if (pid->integrator < pid->limMinInt)
+	{
+		pid->integrator = pid->limMinInt;
+	}
+
+	// Band-limited differentiator
+	pid->differentiator = pid->kdD * Clamp(error - pid->prevError, pid->limD) + pid->alpha * pid->differentiator;
+	pid->differentiator = Clamp(pid->differentiator, TERM_MAX);
+
+	// Output and limits
+	result = pid->proportional + pid->integrator + pid->differentiator + pid->ff;
+	if (result > pid->limMax)
+	{
+		pid->out = (uint16_t)pid->limMax;
+	}
+	else if (result < pid->limMin)
+	{
+		pid->out = (uint16_t)pid->limMin;
+	}
+	else
+	{
+		pid->out = (uint16_t)result;
+	}
+
+	pid->prevError = error;
+	return pid->out;
+}
@@ -0,0 +1,53 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "PidFloat.h"
+// Title 			: Float reference for the fixed point PID controller
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+
+
+#ifndef PIDFLOAT_H_
+#define PIDFLOAT_H_
+
+//==============================================================================================================================
+// Typedefs
+
+typedef struct
+{
+	float Kp;								// Gains
+	float Ki;
+	float Kd;
+	float tau;							// Derivative low-pass filter time constant
+	float limMin;						// Output limits
+	float limMax;
+	float limMinInt;				// Integrator limits
+	float limMaxInt;
+	float T;								// Sample time in seconds
+	float ff;								// Feedforward, added to the output before the limits
+
+	float kiT;							// Worked out from the above by PIDFloat_Init
+	float kdD;
+	float alpha;
+	float limP;							// Input limits that keep each term inside TERM_MAX
+	float limI;
+	float limD;
+
+	float proportional;
+	float integrator;
+	float prevError;				// Required for integrator and differentiator
+	float differentiator;
+
+	uint16_t out;
+} PIDFloat;
+
+//==============================================================================================================================
+// Function Prototypes
+
+void PIDFloat_Init(PIDFloat*);
+uint16_t PIDFloat_Update(PIDFloat*, uint16_t, uint16_t);
+
+#endif /* PIDFLOAT_H_ */
@@ -0,0 +1,70 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Thermal.c"
+// Title 			: Lumped thermal model of the oven
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+//
+// Two heat capacities (elements and cavity) joined by a conductance, a cavity loss that rises faster than linearly with
+// temperature, an extra loss while the door is open and a first order thermocouple. The defaults were fitted to the FinalTemps table of the prototype oven
+// (5% -> 77c, 35% -> 257c) and to its preheat rate at full power.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "thermal.h"
+
+//==============================================================================================================================
+// Global Variables
+
+const THERMAL_PARAMS ThermalDefaults =
+{
+	.Power = 1200.0,
+	.ElementCapacity = 500.0,
+	.OvenCapacity = 800.0,
+	.Coupling = 15.0,
+	.LossLinear = 0.964,
+	.LossQuadratic = 0.00365,
+	.DoorLoss = 10.0,
+	.SensorTau = 3.0,
+	.Ambient = 25.0,
+};
+
+//==============================================================================================================================
+// Start the model with everything at ambient
+
+void ThermalInit(THERMAL_MODEL *model, const THERMAL_PARAMS *params)
+{
+	model->Params = *params;
+	model->Element = params->Ambient;
+	model->Oven = params->Ambient;
+	model->Sensor = params->Ambient;
+	model->DoorOpen = false;
+}
+
+//==============================================================================================================================
+// Advance the model by dt seconds with the elements driven at heat (0 = off, 1 = full power)
+
+void ThermalStep(THERMAL_MODEL *model, double heat, double dt)
+{
+	const THERMAL_PARAMS *p = &model->Params;
+	double transfer = p->Coupling * (model->Element - model->Oven);
+	double rise = model->Oven - p->Ambient;
+	double loss = p->LossLinear * rise + p->LossQuadratic * rise * ((rise > 0) ? rise : -rise);
+
+	if (model->DoorOpen)
+	{
+		loss += p->DoorLoss * rise;
+	}
+
+	model->Element += (heat * p->Power - transfer) * dt / p->ElementCapacity;
+	model->Oven += (transfer - loss) * dt / p->OvenCapacity;
+	model->Sensor += (model->Oven - model->Sensor) * dt / p->SensorTau;
+}
+
+//==============================================================================================================================
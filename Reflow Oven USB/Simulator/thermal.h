@@ -0,0 +1,54 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Thermal.h"
+// Title 			: Lumped thermal model of the oven
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+
+
+#ifndef THERMAL_H_
+#define THERMAL_H_
+
+#include <stdbool.h>
+
+//==============================================================================================================================
+// Typedefs
+
+typedef struct
+{
+	double Power;							// Element power with the SSR on (W)
+	double ElementCapacity;		// Heat capacity of the elements (J/K)
+	double OvenCapacity;			// Heat capacity of the cavity and the board (J/K)
+	double Coupling;					// Element to cavity conductance (W/K)
+	double LossLinear;				// Cavity to ambient conductance (W/K)
+	double LossQuadratic;			// Extra loss that grows with the square of the rise, mostly radiation (W/K^2)
+	double DoorLoss;					// Extra cavity to ambient conductance with the door open (W/K)
+	double SensorTau;					// Thermocouple time constant (s)
+	double Ambient;						// Ambient temperature (C)
+} THERMAL_PARAMS;
+
+typedef struct
+{
+	THERMAL_PARAMS Params;
+	double Element;						// Element temperature (C)
+	double Oven;							// Cavity/board temperature (C)
+	double Sensor;						// Thermocouple junction temperature (C)
+	bool DoorOpen;
+} THERMAL_MODEL;
+
+//==============================================================================================================================
+// Global Variables
+
+extern const THERMAL_PARAMS ThermalDefaults;
+
+//==============================================================================================================================
+// Function Prototypes
+
+void ThermalInit(THERMAL_MODEL*, const THERMAL_PARAMS*);
+void ThermalStep(THERMAL_MODEL*, double, double);
+
+#endif /* THERMAL_H_ */
@@ -0,0 +1,65 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "TypeKGen.c"
+// Title 			: Type K table generator
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+//
+// Prints the TypeKTable initialiser for typek.c from the NIST polynomials, then runs the firmware lookup over the
+// oven's range against the NIST inverse polynomial and prints the worst error. Paste the table into typek.c and
+// rebuild to check the firmware copy.
+
+
+//==============================================================================================================================
+// Includes
+
+#include <math.h>
+#include <stdio.h>
+
+#include "hal.h"
+
+#include "typek.h"
+#include "nist.h"
+
+//==============================================================================================================================
+// The generator entry point
+
+int main(void)
+{
+	double worst = 0, worstTemp = 0, worstJunction = 0;
+	int i;
+
+	printf("static const int16_t TypeKTable[TYPEK_ENTRIES] PROGMEM =\n{");
+	for (i = 0; i < TYPEK_ENTRIES; i++)
+	{
+		printf("%s%ld", (i == 0) ? "\n\t" : (i % 12) ? ", " : ",\n\t", lround(1000.0 * NistTypeKVoltage(TYPEK_MIN + (i << TYPEK_STEP_SHIFT))));
+	}
+	printf("\n};\n");
+
+	// Hot junction 20c to 300c with the controller box anywhere from 0c to 70c
+	for (double junction = 0; junction <= 70.0; junction += 0.5)
+	{
+		for (double t = 20.0; t <= 300.0; t += 0.1)
+		{
+			uint16_t value = (uint16_t)lround(4.0 * NistMax31855Reading(t, junction));
+			int16_t junction16 = (int16_t)lround(16.0 * junction);
+			double reference = NistTypeKTemp(NistTypeKVoltage(junction) + 0.041276 * (value / 4.0 - junction16 / 16.0));
+			double error = TypeKLinearise(value, junction16) / 4.0 - reference;
+
+			if (fabs(error) > fabs(worst))
+			{
+				worst = error;
+				worstTemp = t;
+				worstJunction = junction;
+			}
+		}
+	}
+	fprintf(stderr, "worst error against the NIST inverse %.3fc at %.1fc with the cold junction at %.1fc\n",
+		worst, worstTemp, worstJunction);
+
+	return (fabs(worst) <= 0.25) ? 0 : 1;
+}
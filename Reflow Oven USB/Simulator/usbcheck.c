@@ -0,0 +1,293 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   S I M U L A T O R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "UsbCheck.c"
+// Title 			: USB transmit ring and command line checks
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target			: Host
+// Author			: Simon Ratcliffe
+//
+// Writes to usbtx.c through its stdio put function and drains it into a stand-in for the CDC data IN endpoint, then
+// checks what the host would have read: nothing while no reader has the port open and nothing stale when one opens it,
+// whole text lines and whole telemetry frames dropped oldest first when the ring fills, the =TX counters, and full
+// banks going as soon as they fill. Then feeds usbrx.c from a stand-in data OUT endpoint and checks that commands split
+// across packets, sharing a packet, ending in CR, LF or both, or too long for the buffer come out as the command
+// handler expects. The exit status is 1 if any check failed.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "hal.h"
+
+#include "usbtx.h"
+#include "usbrx.h"
+#include "check.h"
+
+//==============================================================================================================================
+// Defines
+
+#define EP_SIZE					64			// CDC_TX_EPSIZE
+#define HOST_BUF_LEN		1024
+#define LINE_LEN				16			// Command buffer, room for 15 characters
+
+//==============================================================================================================================
+// LUFA stand-ins used by usbtx.c
+
+volatile uint8_t USB_DeviceState = DEVICE_STATE_Configured;
+
+static USB_ClassInfo_CDC_Device_t cdc;
+static int (*txPut)(char, FILE*);
+static uint8_t bank[EP_SIZE];
+static uint8_t bankLength = 0;
+static bool hostReady = true;						// The host has a bank free to take
+static uint8_t hostBuf[HOST_BUF_LEN];			// Everything the host has read
+static uint16_t hostLength = 0;
+static uint16_t packets = 0;
+static const char *rxData = "";						// What the host has sent and the device not yet read
+
+void hal_fdev_setup_stream(FILE *stream, int (*put)(char, FILE*), int (*get)(FILE*), uint8_t flags)
+{
+	txPut = put;
+}
+
+void Endpoint_SelectEndpoint(uint8_t address)
+{
+}
+
+bool Endpoint_IsINReady(void)
+{
+	return hostReady;
+}
+
+bool Endpoint_IsReadWriteAllowed(void)
+{
+	return bankLength < EP_SIZE;
+}
+
+void Endpoint_Write_8(uint8_t data)
+{
+	bank[bankLength++] = data;
+}
+
+void Endpoint_ClearIN(void)
+{
+	memcpy(&hostBuf[hostLength], bank, bankLength);
+	hostLength += bankLength;
+	bankLength = 0;
+	packets++;
+}
+
+int16_t CDC_Device_ReceiveByte(USB_ClassInfo_CDC_Device_t *cdc)
+{
+	return (*rxData) ? (uint8_t)*rxData++ : -1;
+}
+
+//==============================================================================================================================
+// Functions
+
+static void CheckText(const char *what, const char *want)
+{
+	if (!Passed((hostLength == strlen(want)) && (!memcmp(hostBuf, want, hostLength))))
+	{
+		fprintf(stderr, "FAIL %s: got \"%.*s\", want \"%s\"\n", what, hostLength, hostBuf, want);
+	}
+}
+
+static void Write(const void *data, uint16_t length)
+{
+	for (uint16_t i = 0; i < length; i++)
+	{
+		txPut(((const char*)data)[i], NULL);
+	}
+}
+
+static void Print(const char *s)
+{
+	Write(s, strlen(s));
+}
+
+// A telemetry frame: an opening zero, the numbered payload and a closing zero
+static void Frame(uint8_t n)
+{
+	uint8_t frame[10] = {0, n + 1, 1, 2, 3, 4, 5, 6, 7, 0};
+
+	Write(frame, sizeof(frame));
+}
+
+// Let the host take everything, with CDC_Device_USBTask sending the short packet left at the end
+static void Drain(void)
+{
+	hostReady = true;
+	UsbTxDrain();
+	if (bankLength)
+	{
+		Endpoint_ClearIN();
+	}
+}
+
+static void Reset(void)
+{
+	hostLength = 0;
+	packets = 0;
+}
+
+// Send a packet and check the line, if any, the next pass of the USB task gets from it
+static void CheckLine(const char *what, char *buf, const char *packet, const char *want)
+{
+	bool got;
+
+	rxData = packet;
+	got = UsbRxGetLine(buf, LINE_LEN);
+	if (!Passed((want == NULL) ? !got : (got && (!strcmp(buf, want)))))
+	{
+		fprintf(stderr, "FAIL %s: got %s, want %s\n", what, got ? buf : "nothing", want ? want : "nothing");
+	}
+}
+
+static void CheckReport(const char *what, const char *want)
+{
+	char report[32] = {0};
+	FILE *stream = fmemopen(report, sizeof(report), "w");
+
+	UsbTxReport(stream);
+	fclose(stream);
+	if (!Passed(!strcmp(report, want)))
+	{
+		fprintf(stderr, "FAIL %s: got %s, want %s", what, report, want);
+	}
+}
+
+//==============================================================================================================================
+// The check entry point
+
+int main(void)
+{
+	char line[16];
+	char command[LINE_LEN];
+	uint16_t i;
+
+	cdc.State.LineEncoding.BaudRateBPS = 115200;
+	UsbTxInit(&cdc, stdout);
+	UsbRxInit(&cdc);
+
+	// No reader, nothing is kept
+	Print("nobody\n");
+	Check("no reader free", UsbTxFree(), USB_TX_SIZE);
+	Drain();
+	CheckText("no reader", "");
+
+	// A reader gets what is written from then on, once the host has configured the port
+	UsbTxSetReader(true);
+	Print("hello\n");
+	Check("reader free", UsbTxFree(), USB_TX_SIZE - 6);
+	USB_DeviceState = 0;
+	Drain();
+	CheckText("not configured", "");
+	USB_DeviceState = DEVICE_STATE_Configured;
+	cdc.State.LineEncoding.BaudRateBPS = 0;
+	Drain();
+	CheckText("no line coding", "");
+	cdc.State.LineEncoding.BaudRateBPS = 115200;
+	hostReady = false;
+	UsbTxDrain();
+	CheckText("host busy", "");
+	Drain();
+	CheckText("reader", "hello\n");
+	Check("drained free", UsbTxFree(), USB_TX_SIZE);
+
+	// Closing and opening the port throws away what the last reader left
+	Reset();
+	Print("stale\n");
+	UsbTxSetReader(false);
+	Print("lost\n");
+	UsbTxSetReader(true);
+	Print("fresh\n");
+	Drain();
+	CheckText("new reader", "fresh\n");
+	CheckReport("no drops", "=TX,0,0,6\n");
+
+	// Twenty 8 byte lines into the 128 byte ring, the four oldest go
+	Reset();
+	hostReady = false;
+	for (i = 0; i < 20; i++)
+	{
+		sprintf(line, "line %02u\n", i);
+		Print(line);
+	}
+	Check("full free", UsbTxFree(), 0);
+	Drain();
+	Check("lines length", hostLength, 16 * 8);
+	Check("oldest line kept", memcmp(hostBuf, "line 04\n", 8), 0);
+	Check("newest line kept", memcmp(&hostBuf[15 * 8], "line 19\n", 8), 0);
+	CheckReport("line drops", "=TX,4,32,128\n");
+
+	// Full banks go as they fill, the rest waits for CDC_Device_USBTask
+	Reset();
+	for (i = 0; i < 10; i++)
+	{
+		sprintf(line, "bank %02u\n", i);
+		Print(line);
+	}
+	UsbTxDrain();
+	Check("full banks", packets, 1);
+	Check("short bank", bankLength, 80 - EP_SIZE);
+	Drain();
+	Check("banks", hostLength, 80);
+
+	// Frames are dropped whole, from the opening zero to the closing one, and the line ahead of them as a line
+	Reset();
+	hostReady = false;
+	Print("start\n");
+	for (i = 0; i < 20; i++)
+	{
+		Frame(i);
+	}
+	Drain();
+	Check("frames length", hostLength, 12 * 10);
+	for (i = 0; i < 12; i++)
+	{
+		Check("frame open", hostBuf[i * 10], 0);
+		Check("frame number", hostBuf[i * 10 + 1], i + 9);
+		Check("frame close", hostBuf[i * 10 + 9], 0);
+	}
+	CheckReport("frame drops", "=TX,13,118,128\n");
+
+	// A message longer than the ring goes a ring at a time, the next one is whole
+	Reset();
+	hostReady = false;
+	for (i = 0; i < 200; i++)
+	{
+		Print("x");
+	}
+	Print("\nok\n");
+	Drain();
+	Check("long message length", hostLength, 200 - USB_TX_SIZE + 4);
+	Check("next message", memcmp(&hostBuf[hostLength - 3], "ok\n", 3), 0);
+
+	// A command split across packets comes out once its end arrives
+	CheckLine("split start", command, "**ST", NULL);
+	CheckLine("split middle", command, "AT", NULL);
+	CheckLine("split end", command, "S\r", "**STATS");
+
+	// CR, LF and CR LF all end a command and blank lines are skipped
+	CheckLine("LF", command, "**A\n", "**A");
+	CheckLine("CR LF", command, "\n**B\r\n", "**B");
+	CheckLine("blank lines", command, "\r\n\r\n\n", NULL);
+
+	// Two commands in one packet, the second is left in the endpoint for the next pass
+	CheckLine("shared first", command, "**C\r\n**D\r\n", "**C");
+	CheckLine("shared second", command, rxData, "**D");
+	CheckLine("shared done", command, rxData, NULL);
+
+	// The longest command that fits, then one a character too long is thrown away up to its end and the next is whole
+	CheckLine("longest", command, "**PGET=12345678\n", "**PGET=12345678");
+	CheckLine("too long", command, "**PGET=123456789", NULL);
+	CheckLine("too long end", command, "0\r", NULL);
+	CheckLine("after too long", command, "\n**E\n", "**E");
+	CheckLine("too long shared", command, "**PGET=1234567890\r\n**F\r\n", "**F");
+
+	return CheckDone("usb");
+}
@@ -0,0 +1,138 @@
+//==============================================================================================================================
+// F R O N T   P A N E L   B U T T O N S
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Buttons.c"
+// Title 			: Debounced, interrupt driven front panel buttons
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+//
+// The switches on C.4 to C.7 interrupt on every edge (pin change for C.4 to C.6, INT4 for C.7) and each edge restarts
+// the debounce count. The 10ms timer slot reads the pins once they have been quiet for BUTTON_DEBOUNCE_SLOTS and queues
+// a press or release for each switch that changed, then repeats UP or DOWN while it is held. A press starts the key
+// click on the buzzer, so nothing on the input path waits.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "hal.h"
+
+#include "menu.h"
+#include "buttons.h"
+#include "buzzer.h"
+
+//==============================================================================================================================
+// Defines
+
+#define BUTTON_QUEUE_LEN	8						// Power of two
+#define BUTTON_QUEUE_MASK	(BUTTON_QUEUE_LEN - 1)
+
+//==============================================================================================================================
+// Private variables
+
+static volatile uint8_t buttonQueue[BUTTON_QUEUE_LEN];
+static volatile uint8_t buttonHead = 0;	// Written by the timer interrupt only
+static volatile uint8_t buttonTail = 0;	// Written by the main loop only
+static volatile uint8_t debounceCountdown = 0;
+static uint8_t stable = 0;							// Debounced state, EVENT_ bits
+static uint8_t repeatCountdown = 0;
+
+//==============================================================================================================================
+// Functions
+
+static inline void PushButtonEvent(uint8_t event)
+{
+	uint8_t head = buttonHead;
+
+	if ((uint8_t)(head - buttonTail) >= BUTTON_QUEUE_LEN)
+	{
+		return; // Nobody is reading the panel, drop the new event
+	}
+	buttonQueue[head & BUTTON_QUEUE_MASK] = event;
+	buttonHead = head + 1;
+}
+
+//==============================================================================================================================
+// Called from the pin change interrupts, the switch is bouncing so wait for it to settle
+
+void ButtonsEdge(void)
+{
+	debounceCountdown = BUTTON_DEBOUNCE_SLOTS;
+}
+
+#ifndef HOST_BUILD
+ISR (INT4_vect)
+{
+	ButtonsEdge();
+}
+#endif
+
+//==============================================================================================================================
+// Called from the timer interrupt every 10ms slot
+
+void ButtonsSlot(void)
+{
+	uint8_t state;
+	uint8_t changed;
+	uint8_t bit;
+
+	if (debounceCountdown)
+	{
+		if (--debounceCountdown)
+		{
+			return; // Still settling
+		}
+		state = (~PINC >> 4) & BUTTON_MASK;
+		changed = state ^ stable;
+		stable = state;
+
+		for (bit = 1; bit & BUTTON_MASK; bit <<= 1)
+		{
+			if (changed & bit)
+			{
+				PushButtonEvent(((state & bit) ? BUTTON_PRESS : BUTTON_RELEASE) | bit);
+			}
+		}
+		if (changed & state)
+		{
+			BuzzerStart(BEEP_KEY);
+		}
+		repeatCountdown = BUTTON_REPEAT_DELAY; // Any change starts the hold again
+		return;
+	}
+
+	// Only a single UP or DOWN held on its own repeats
+	if (((stable == EVENT_UP_BUTTON_PUSHED) || (stable == EVENT_DOWN_BUTTON_PUSHED)) && (--repeatCountdown == 0))
+	{
+		repeatCountdown = BUTTON_REPEAT_SLOTS;
+		PushButtonEvent(BUTTON_REPEAT | stable);
+	}
+}
+
+//==============================================================================================================================
+// Next button event, or 0 if there are none
+
+uint8_t ButtonsGetEvent(void)
+{
+	uint8_t tail = buttonTail;
+	uint8_t event;
+
+	if (tail == buttonHead)
+	{
+		return 0;
+	}
+	event = buttonQueue[tail & BUTTON_QUEUE_MASK];
+	buttonTail = tail + 1;
+	return event;
+}
+
+//==============================================================================================================================
+// Debounced state of the switches, EVENT_ bits
+
+uint8_t ButtonsHeld(void)
+{
+	return stable;
+}
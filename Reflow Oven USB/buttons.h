@@ -0,0 +1,38 @@
+//==============================================================================================================================
+// F R O N T   P A N E L   B U T T O N S
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Buttons.h"
+// Title 			: Debounced, interrupt driven front panel buttons
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+
+
+#ifndef BUTTONS_H_
+#define BUTTONS_H_
+
+//==============================================================================================================================
+// Defines
+
+// An event is one of these in the high nibble and the EVENT_ button bit from menu.h in the low nibble
+#define BUTTON_PRESS			0x10
+#define BUTTON_RELEASE		0x20
+#define BUTTON_REPEAT			0x30
+#define BUTTON_TYPE_MASK	0xF0
+#define BUTTON_MASK				0x0F
+
+#define BUTTON_DEBOUNCE_SLOTS		3				// Quiet 10ms slots after the last edge before the pins are believed
+#define BUTTON_REPEAT_DELAY			50			// Slots held before UP or DOWN starts to repeat
+#define BUTTON_REPEAT_SLOTS			15			// Slots between repeats
+
+//==============================================================================================================================
+// Function Prototypes
+
+	void ButtonsEdge(void);
+	void ButtonsSlot(void);
+	uint8_t ButtonsGetEvent(void);
+	uint8_t ButtonsHeld(void);
+
+#endif /* BUTTONS_H_ */
@@ -0,0 +1,161 @@
+//==============================================================================================================================
+// B U Z Z E R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Buzzer.c"
+// Title 			: Timer driven buzzer pattern player
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+//
+// The buzzer on D.7 sounds by itself when driven high, and D.7 has no timer output, so a pattern is a list of on and off
+// times in 10ms slots that the timer interrupt steps through. Starting a pattern costs the caller nothing more than
+// setting it going, and a pattern only replaces one of the same or lower priority, so a key click never cuts short an
+// alarm.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "hal.h"
+
+#include "buzzer.h"
+
+//==============================================================================================================================
+// Defines
+
+#define BUZZER_IDLE				0xFF
+
+//==============================================================================================================================
+// Typedefs
+
+typedef struct
+{
+	uint8_t On;							// Slots sounding, 0 ends the pattern
+	uint8_t Off;						// Slots quiet after
+} BUZZER_STEP;
+
+typedef struct
+{
+	uint8_t First;					// Index of the first step in buzzerSteps
+	uint8_t Repeat;					// Times through the steps, at least one
+	uint8_t Priority;
+} BUZZER_PATTERN;
+
+//==============================================================================================================================
+// PROGMEM patterns
+
+static const BUZZER_STEP buzzerSteps[] PROGMEM =
+{
+	{1, 0}, {0, 0},													// Key click, 10ms
+	{50, 50}, {0, 0},												// Run end, half second beeps
+	{10, 10}, {10, 10}, {10, 60}, {0, 0}		// Fault, three quick beeps and a gap
+};
+
+static const BUZZER_PATTERN buzzerPatterns[] PROGMEM =
+{
+	{0, 1, 0},															// BEEP_KEY
+	{2, 10, 1},															// BEEP_RUN_END, ten seconds
+	{4, 5, 2}																// BEEP_FAULT, five and a half seconds
+};
+
+//==============================================================================================================================
+// Private variables
+
+static volatile uint8_t buzzerPattern = BUZZER_IDLE;
+static uint8_t buzzerStep;
+static uint8_t buzzerRepeat;
+static uint8_t buzzerCountdown;
+static bool buzzerOn;
+
+//==============================================================================================================================
+// Functions
+
+static void BuzzerLoadStep(void)
+{
+	buzzerCountdown = pgm_read_byte(&buzzerSteps[buzzerStep].On);
+	buzzerOn = true;
+}
+
+//==============================================================================================================================
+// Called from the timer interrupt every 10ms slot, ahead of anything in the slot that starts a pattern
+
+void BuzzerSlot(void)
+{
+	uint8_t off;
+
+	if ((buzzerPattern != BUZZER_IDLE) && (--buzzerCountdown == 0))
+	{
+		off = pgm_read_byte(&buzzerSteps[buzzerStep].Off);
+		if ((buzzerOn) && (off))
+		{
+			buzzerOn = false;
+			buzzerCountdown = off;
+		}
+		else
+		{
+			buzzerStep++;
+			if ((pgm_read_byte(&buzzerSteps[buzzerStep].On) == 0) && (--buzzerRepeat))
+			{
+				buzzerStep = pgm_read_byte(&buzzerPatterns[buzzerPattern].First); // Round again
+			}
+			if (pgm_read_byte(&buzzerSteps[buzzerStep].On))
+			{
+				BuzzerLoadStep();
+			}
+			else
+			{
+				buzzerPattern = BUZZER_IDLE;
+			}
+		}
+	}
+
+	// Written every slot, so the LCD's read-modify-write of port D can't leave the buzzer stuck on
+	if ((buzzerPattern != BUZZER_IDLE) && (buzzerOn))
+	{
+		PORTD |= _BV(PD7);
+	}
+	else
+	{
+		PORTD &= ~_BV(PD7);
+	}
+}
+
+//==============================================================================================================================
+// Start a pattern unless one of higher priority is playing. Interrupts must be off.
+
+void BuzzerStart(uint8_t pattern)
+{
+	if ((buzzerPattern != BUZZER_IDLE) &&
+		(pgm_read_byte(&buzzerPatterns[pattern].Priority) < pgm_read_byte(&buzzerPatterns[buzzerPattern].Priority)))
+	{
+		return;
+	}
+	buzzerPattern = pattern;
+	buzzerStep = pgm_read_byte(&buzzerPatterns[pattern].First);
+	buzzerRepeat = pgm_read_byte(&buzzerPatterns[pattern].Repeat);
+	BuzzerLoadStep();
+	PORTD |= _BV(PD7);
+}
+
+//==============================================================================================================================
+// Start a pattern from the main loop
+
+void BuzzerPlay(uint8_t pattern)
+{
+	cli();
+	BuzzerStart(pattern);
+	sei();
+}
+
+//==============================================================================================================================
+// Silence whatever is playing
+
+void BuzzerStop(void)
+{
+	cli();
+	buzzerPattern = BUZZER_IDLE;
+	PORTD &= ~_BV(PD7);
+	sei();
+}
@@ -0,0 +1,32 @@
+//==============================================================================================================================
+// B U Z Z E R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Buzzer.h"
+// Title 			: Timer driven buzzer pattern player
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+
+
+#ifndef BUZZER_H_
+#define BUZZER_H_
+
+//==============================================================================================================================
+// Defines
+
+// Patterns, in buzzerPatterns order
+#define BEEP_KEY					0				// Key click
+#define BEEP_RUN_END			1				// Run finished, open the door
+#define BEEP_FAULT				2				// Run ended by a thermocouple fault or over temperature
+
+//==============================================================================================================================
+// Function Prototypes
+
+	void BuzzerSlot(void);
+	void BuzzerStart(uint8_t);
+	void BuzzerPlay(uint8_t);
+	void BuzzerStop(void);
+
+#endif /* BUZZER_H_ */
@@ -0,0 +1,1852 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   C O N T R O L   C O R E
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Control.c"
+// Title 			: Oven control core (temperature acquisition, profile and calibration stages)
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2 (or host, see hal.h)
+// Author			: Simon Ratcliffe
+//
+// Everything in here talks to the hardware through hal.h only, so the same file is built into the firmware and into
+// the host simulator in the Simulator directory.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "hal.h"
+
+#include "ReflowOven.h"
+#include "control.h"
+#include "lcd.h"
+#include "spi.h"
+#include "menu.h"
+#include "history.h"
+#include "buttons.h"
+#include "buzzer.h"
+#include "telemetry.h"
+
+//==============================================================================================================================
+// EEPROM Variables and Data
+
+uint8_t EEMEM OvenCalibrated = 1;
+uint8_t EEMEM ProfileCount = 3;
+
+__profile EEMEM Profiles[MAX_PROFILES] = 
+{
+	{"Default         ",1,150,8,8,60,180,60,215,131,206},			  // for small low density boards
+	{"Bigger Board    ",1,150,6,8,120,180,90,215,138,206},			// for larger high density boards
+	{"Leadfree        ",1,150,12,8,120,200,120,255,138,248} 
+};
+
+//__profile EEMEM Profiles[MAX_PROFILES] = {{"Leadfree",1,150,3,2,200,120,255,138,248}}; //perfect for leaded solder
+// original production profile that was used in the first 2 years __profile EEMEM Profiles[MAX_PROFILES] = {{"Default",1,150,2,4,180,90,215,124,204}};
+// setup __profile EEMEM Profiles[MAX_PROFILES] = {{"Default",0,150,2,4,180,90,220,0,0}};
+// 210 reflow __profile EEMEM Profiles[MAX_PROFILES] = {{"Default",1,150,2,4,180,90,210,123,199}};
+
+uint8_t EEMEM TempCounts[20] = {18,14,14,15,11,10,11,11,10,12,11,12,12,11,12,13,18,15,16,16};
+uint16_t EEMEM FinalTemps[20] = {77,117,153,185,213,237,257,0,0,0,0,0,0,0,0,0,0,0,0,0};
+
+// Hand tuned gains until the oven has been autotuned
+__pidParams EEMEM PidParams = {0, PID_Q16(5.0), PID_Q16(0.1), PID_Q16(100.0), PID_Q16(10.0), 0, 0};
+
+// Thermal model found by the identification run
+__ovenModel EEMEM OvenModel = {0, 0, 0};
+
+// Control ticks per second, see setControlRate
+uint8_t EEMEM ControlRate = 2;
+
+//==============================================================================================================================
+// Defines
+
+// Timer1 slots (10ms) per thermocouple sample and per history sample, the control tick is set by setControlRate
+#define SAMPLE_SLOTS			10
+#define HISTORY_SLOTS			50
+#define SLOT_MS						10
+
+// Timer1 to main loop events waiting at most, must be a power of two. A second and a bit at 10Hz.
+#define EVENT_QUEUE_LEN		16
+#define EVENT_QUEUE_MASK	(EVENT_QUEUE_LEN - 1)
+
+// Control tick, a whole number of slots and no faster than the thermocouple converts
+#define CONTROL_RATE_DEFAULT	2		// Hz
+#define TICKS(s)					((uint16_t)(s) * controlRate)
+
+// Heater duty in 1/256 percent
+#define DUTY_FULL					(100 << 8)
+
+// Heater relay sequencing, run from the Timer1 slot. The EMR only switches with the SSR off and the SSR only fires once
+// the EMR contacts have settled, both take up to 25ms.
+#define HEATER_OFF				0		// EMR open, SSR off
+#define HEATER_ARMING			1		// EMR closed, SSR held off for HEATER_DWELL_SLOTS
+#define HEATER_ON					2		// SSR follows the modulator
+#define HEATER_DISARMING	3		// SSR off, EMR opens after HEATER_DWELL_SLOTS
+#define HEATER_DWELL_SLOTS	3
+
+// Safety supervisor, checked from the interrupts. Samples are only linearised once the raw reading is near the limit
+// (SAFETY_MAX_TEMP in control.h), the MAX31855 reads about 4c low at 270c.
+#define SAFETY_NEAR_TEMP	(SAFETY_MAX_TEMP - 80)
+
+// Zero-cross, periods in Timer1 counts (8us). Half cycles are 1250 at 50Hz and 1042 at 60Hz.
+#define ZC_MIN_PERIOD			900		// Mains is 45Hz to 65Hz, anything else isn't a zero crossing
+#define ZC_MAX_PERIOD			1400
+#define ZC_LOCK_EDGES			8			// Good crossings in a row before the SSR follows them
+#define ZC_TIMEOUT_SLOTS	3			// Back to the timer if a crossing is 30ms late
+
+// Temperature deltas compare the newest HISTORY_WINDOW samples with the ones 4, 16 and 32 seconds earlier, the rate of
+// change does the same over 4 seconds of ovenDelta4. Lags are in half second history samples whatever the control
+// rate, the history is sized from the largest one.
+#define OVEN_DELTA4_LAG		8
+#define OVEN_DELTA16_LAG	32
+#define OVEN_DELTA32_LAG	64
+#define OVEN_RATE_LAG			8
+
+// Profile setpoint trajectory, all in 0.25c steps
+#define PROFILE_RAMP_RATE	(6 << 8)	// 1.5c/s, in 1/256 steps per second
+#define PROFILE_MAX_LEAD	80		// The ramp waits while the oven is 20c behind
+#define PROFILE_BAND			8			// A ramp target counts as reached within 2c
+
+// Oven identification, temperatures in 0.25c steps and times in seconds. Rates are ovenDelta32 units, 1/16c over 32
+// seconds.
+#define IDENT_TOP					1000	// Heat at full power to 250c then let it cool
+#define IDENT_LIMIT				1080	// Highest temperature FinalTemps is extended to
+#define IDENT_BIN_FIRST		160		// Rates are taken every 16c from 40c
+#define IDENT_BIN_SHIFT		6
+#define IDENT_BINS				14
+#define IDENT_SETTLE			100		// After the heat goes off, until the elements and cavity cool together
+#define IDENT_PRIMED			34		// ovenDelta32 covers the run
+#define IDENT_COOL_END		480		// Stop cooling at 120c, the rise rates cover below that
+#define IDENT_TIMEOUT			1200	// or after 20 minutes
+
+// The first two stages of every run that starts from the front panel
+#define STAGE_CLOSE_DOOR	{0, 0, 0, 0, StageCloseDoor, NULL, NULL, NULL, NULL}, \
+													{1, 0, 0, 0, NULL, NULL, NULL, EnterPressed, NULL}
+
+// Duty map
+#define DUTY_MAP_AMBIENT	100		// No heat holds the oven at 25c
+
+// Relay autotune, temperatures in 0.25c steps and times in seconds
+#define AUTOTUNE_SETPOINT	720		// 180c, between the soak and reflow temps
+#define AUTOTUNE_HYST			2			// Relay switches 0.5c either side of the setpoint
+#define AUTOTUNE_SETTLE		1			// Cycles thrown away before measuring
+#define AUTOTUNE_CYCLES		3			// Cycles averaged
+#define AUTOTUNE_TIMEOUT	1800	// Give up after 30 minutes
+
+//==============================================================================================================================
+// Global Variables
+
+bool isRunning = false;
+bool showTemp = true;
+uint32_t ovenTempAccum = 0;
+uint16_t ovenTemp;
+uint32_t historyAccum = 0;
+uint8_t historyReadings = 0;
+uint16_t ovenSetpoint; // Profile setpoint in 0.25c steps
+int16_t ovenJunctionAccum = 0;
+int16_t ovenJunction; // Converter cold junction in 0.0625c steps
+uint8_t ovenFaultsAccum = 0;
+uint8_t ovenFaults; // SPI_FAULT_ bits seen over the last tick
+uint16_t ovenEndTemp;
+int16_t ovenDelta4;
+int16_t ovenDelta16;
+int16_t ovenDelta32;
+int16_t ovenRateOfChange;
+uint8_t deltaCount = 0;
+uint8_t ovenStage; // Used to store where a task is up to
+uint16_t ovenCounter;
+int16_t ovenError = 0;
+void(*ProcessHandler)();
+uint16_t count = 0; // Control ticks
+uint16_t endCount = 3600;
+uint8_t endSet = 0;
+__profile profile;
+uint8_t tick = 0; // Set while the stage handler runs for a control tick
+volatile uint8_t sampleCountdown = SAMPLE_SLOTS / 2; // Samples land half way between ticks
+volatile uint8_t tickCountdown = 100 / CONTROL_RATE_DEFAULT;
+volatile uint8_t tickSlots = 100 / CONTROL_RATE_DEFAULT;
+volatile uint8_t historyCountdown = HISTORY_SLOTS;
+volatile uint32_t uptime = 0; // ms at the last compare match
+uint8_t controlRate = CONTROL_RATE_DEFAULT; // Control ticks per second
+uint16_t controlPeriod = 1000 / CONTROL_RATE_DEFAULT; // ms per control tick
+uint16_t rampAccum = 0;
+volatile uint32_t timerBase = 0; // Timer1 counts at the last compare match
+volatile uint8_t duty_cycle = 0; // Last duty asked for, whole percent
+volatile uint16_t dutyBuffer[2] = {0, 0}; // DUTY_FULL steps, the ISR only reads dutyBuffer[dutyIndex]
+volatile uint8_t dutyIndex = 0;
+uint16_t dutyAccum = 0;
+volatile uint8_t heaterState = HEATER_OFF;
+volatile uint8_t heaterDwell = 0;
+volatile uint8_t safetyTrip = 0; // SAFETY_ reason, latched until SafetyService has ended the run
+volatile uint16_t safetyLatency = 0; // Timer1 counts from the cause to the SSR being off
+volatile uint32_t menuPressTime = 0; // Timer1 counts when the debounced MENU press was queued
+volatile bool menuHeld = false;
+volatile uint8_t zcLock = 0; // Good crossings seen, up to ZC_LOCK_EDGES
+volatile uint16_t zcPeriod = 0; // Half cycle, averaged
+volatile uint8_t zcTimeout = 0;
+uint32_t zcLast = 0;
+uint8_t zcReported = 0;
+uint8_t readings = 0;
+PIDController pid;
+
+// Single producer (TIMER1_COMPA_vect) single consumer (ControlTask) event queue, the same scheme as the SPI sample queue
+static CONTROL_EVENT eventQueue[EVENT_QUEUE_LEN];
+static volatile uint8_t eventHead = 0;
+static volatile uint8_t eventTail = 0;
+volatile uint8_t eventOverruns = 0;
+uint8_t eventDepthMax = 0; // Most events ever found waiting, how far behind the main loop has been
+static uint8_t overrunsReported = 0;
+
+// FinalTemps as a rising map from temperature (0.25c steps) to duty (%), with an ambient point in front
+static uint16_t dutyMapTemps[21] = {DUTY_MAP_AMBIENT};
+static uint8_t dutyMapDuty[21] = {0};
+static uint8_t dutyMapCount = 1;
+
+// Stage engine state
+static const STAGE *stageTable;
+static uint8_t stageIndex;
+static bool stageEntered;
+static uint16_t stageTicks; // Control ticks in the stage, for its Timeout
+static uint8_t stageArg; // The stage's Arg, for the actions
+static bool stageHostStart; // Started by the host, which has seen to the door
+
+// Oven identification state
+static int16_t identHeat[IDENT_BINS];
+static int16_t identCool[IDENT_BINS];
+static uint8_t identNext;
+
+// Relay autotune state
+static uint8_t tuneBias;
+static uint8_t tuneStep;
+static bool tuneHigh;
+static uint8_t tuneCycles;
+static uint16_t tuneMax;
+static uint16_t tuneMin;
+static uint16_t tuneSwitch;
+static uint16_t tuneAmplitude;
+static uint16_t tunePeriod;
+
+static const uint8_t ovenTempLags[] = {OVEN_DELTA4_LAG, OVEN_DELTA16_LAG, OVEN_DELTA32_LAG};
+static uint16_t ovenTempSamples[OVEN_DELTA32_LAG + HISTORY_WINDOW];
+static uint16_t ovenTempSums[1 + sizeof(ovenTempLags)];
+static HISTORY ovenTempHistory = {ovenTempSamples, ovenTempLags, ovenTempSums, OVEN_DELTA32_LAG + HISTORY_WINDOW, sizeof(ovenTempLags), 0, false};
+
+static const uint8_t ovenDelta4Lags[] = {OVEN_RATE_LAG};
+static uint16_t ovenDelta4Samples[OVEN_RATE_LAG + HISTORY_WINDOW];
+static uint16_t ovenDelta4Sums[1 + sizeof(ovenDelta4Lags)];
+static HISTORY ovenDelta4History = {ovenDelta4Samples, ovenDelta4Lags, ovenDelta4Sums, OVEN_RATE_LAG + HISTORY_WINDOW, sizeof(ovenDelta4Lags), 0, false};
+
+//==============================================================================================================================
+// Function Prototypes (Private)
+
+static void StageStop(void);
+static void StageHandler(void);
+
+//==============================================================================================================================
+// Interrupt routines
+
+// Cut the heater straight away and latch why, the main loop ends the run from SafetyService. Interrupts must be off.
+static void SafetyTrip(uint8_t reason, uint32_t since)
+{
+	SSR_OFF;
+	dutyBuffer[0] = 0;
+	dutyBuffer[1] = 0;
+	if ((heaterState == HEATER_ARMING) || (heaterState == HEATER_ON))
+	{
+		heaterState = HEATER_DISARMING;
+		heaterDwell = HEATER_DWELL_SLOTS;
+	}
+	if (!safetyTrip)
+	{
+		since = TimerNow() - since;
+		safetyLatency = (since > 0xFFFF) ? 0xFFFF : (uint16_t)since; // A main loop abort can be held up past 0.5s
+		safetyTrip = reason;
+	}
+}
+
+// Sigma-delta, the SSR is on for the coming slot (or half cycle) whenever the duty carried forward makes up a whole one
+static inline void DutyStep(void)
+{
+	if (heaterState != HEATER_ON)
+	{
+		SSR_OFF;
+		dutyAccum = 0;
+		return;
+	}
+
+	dutyAccum += dutyBuffer[dutyIndex];
+	if (dutyAccum >= DUTY_FULL)
+	{
+		dutyAccum -= DUTY_FULL;
+		SSR_ON;
+	}
+	else
+	{
+		SSR_OFF;
+	}
+}
+
+static inline void PushEvent(uint8_t type)
+{
+	uint8_t head = eventHead;
+
+	if ((uint8_t)(head - eventTail) >= EVENT_QUEUE_LEN)
+	{
+		eventOverruns++; // Main loop has fallen a whole queue behind, drop the new event
+		return;
+	}
+	eventQueue[head & EVENT_QUEUE_MASK].Type = type;
+	eventQueue[head & EVENT_QUEUE_MASK].Time = timerBase;
+	eventHead = head + 1;
+}
+
+ISR (TIMER1_COMPA_vect)
+{
+	timerBase += TIMER1_PERIOD;
+	uptime += SLOT_MS;
+
+	if ((heaterDwell) && (--heaterDwell == 0))
+	{
+		if (heaterState == HEATER_ARMING)
+		{
+			heaterState = HEATER_ON;
+		}
+		else if (heaterState == HEATER_DISARMING)
+		{
+			EMR_OFF;
+			heaterState = HEATER_OFF;
+		}
+	}
+
+	BuzzerSlot();
+	ButtonsSlot();
+	if ((ButtonsHeld() & EVENT_MENU_BUTTON_PUSHED) && (!menuHeld))
+	{
+		menuPressTime = timerBase;
+	}
+	menuHeld = (ButtonsHeld() & EVENT_MENU_BUTTON_PUSHED) != 0;
+
+	if (--sampleCountdown == 0)
+	{
+		sampleCountdown = SAMPLE_SLOTS;
+		spi_start(); // Sample the thermocouple every 100ms
+	}
+
+	// A window ahead of a tick in the same slot, so the packet carries the new deltas
+	if (--historyCountdown == 0)
+	{
+		historyCountdown = HISTORY_SLOTS;
+		PushEvent(CONTROL_WINDOW);
+	}
+
+	if (--tickCountdown == 0)
+	{
+		tickCountdown = tickSlots;
+		PushEvent(CONTROL_TICK);
+	}
+
+	// Once the zero-cross has locked it clocks the modulator instead
+	if (zcTimeout)
+	{
+		zcTimeout--;
+		if (zcLock == ZC_LOCK_EDGES)
+		{
+			return;
+		}
+	}
+	else
+	{
+		zcLock = 0;
+	}
+
+	DutyStep();
+}
+
+//==============================================================================================================================
+// Rising edge of the zero-cross pulse, the SSR gets whole half cycles from here
+
+ISR (PCINT0_vect)
+{
+	uint32_t now;
+	uint16_t period;
+
+	if (!(PINB & _BV(ZERO_CROSS_PIN)))
+	{
+		return;
+	}
+
+	now = TimerNow(); // Same timestamp as the SPI samples
+
+	period = (uint16_t)(now - zcLast);
+	if ((zcLock) && (period < ((zcPeriod >> 1) + (zcPeriod >> 2))))
+	{
+		return; // Noise, too soon after the last crossing
+	}
+	zcLast = now;
+	zcTimeout = ZC_TIMEOUT_SLOTS;
+
+	if ((period < ZC_MIN_PERIOD) || (period > ZC_MAX_PERIOD))
+	{
+		zcLock = 0;
+		return;
+	}
+	if (zcLock == 0)
+	{
+		zcPeriod = period;
+	}
+	else
+	{
+		zcPeriod += ((int16_t)(period - zcPeriod)) >> 3;
+	}
+	if (zcLock < ZC_LOCK_EDGES)
+	{
+		zcLock++;
+		if (zcLock < ZC_LOCK_EDGES)
+		{
+			return;
+		}
+	}
+
+	DutyStep();
+}
+
+//==============================================================================================================================
+// The MENU button aborts a run from here, without waiting for the main loop or the debounce. The edge is the cause, so
+// the reaction is the few instructions to SafetyTrip and reports as 0.
+
+ISR (PCINT1_vect)
+{
+	uint32_t now = TimerNow();
+
+	ButtonsEdge();
+	if ((!(PINC & _BV(ABORT_PIN))) && (isRunning))
+	{
+		SafetyTrip(SAFETY_ABORT, now);
+	}
+}
+
+//==============================================================================================================================
+// Called by the SPI interrupt with each frame, before it is queued. The reaction runs from when the frame was started.
+
+void SafetyCheckSample(const SPI_SAMPLE *sample, uint32_t start)
+{
+	if ((heaterState != HEATER_ARMING) && (heaterState != HEATER_ON))
+	{
+		return;
+	}
+	if (sample->Faults)
+	{
+		SafetyTrip(SAFETY_SENSOR, start);
+	}
+	else if ((sample->Value > SAFETY_NEAR_TEMP) && (spi_temperature(sample) > SAFETY_MAX_TEMP))
+	{
+		SafetyTrip(SAFETY_OVERTEMP, start);
+	}
+}
+
+//==============================================================================================================================
+// Abort from the main loop, for a MENU press the pin change missed, timed from the debounced press, or for the host
+
+void SafetyAbort(void)
+{
+	cli();
+	SafetyTrip(SAFETY_ABORT, menuHeld ? menuPressTime : TimerNow());
+	sei();
+}
+
+//==============================================================================================================================
+// End the run after a trip and report it with the reaction time in us. Returns false if nothing has tripped.
+
+bool SafetyService(void)
+{
+	uint8_t reason = safetyTrip;
+
+	if (!reason)
+	{
+		return false;
+	}
+	fprintf_P(&USBSerialStream, PSTR("=TRIP,%u,%lu\n"), reason, (unsigned long)safetyLatency * 8);
+	fprintf_P(&USBSerialStream, (reason == SAFETY_OVERTEMP) ? PSTR("=END\n") : PSTR("=ABORT\n"));
+	if (reason == SAFETY_ABORT)
+	{
+		BuzzerStop(); // Asked for, nothing to alarm about
+	}
+	else
+	{
+		BuzzerPlay(BEEP_FAULT);
+	}
+	endCount = TICKS(1800);
+	endSet = 0;
+	StageStop();
+	safetyTrip = 0;
+	return true;
+}
+
+//==============================================================================================================================
+// Timer1 counts (8us) since power up, the clock the samples and events are stamped with
+
+uint32_t GetTimerCounts(void)
+{
+	uint32_t time;
+
+	cli();
+	time = TimerNow();
+	sei();
+
+	return time;
+}
+
+//==============================================================================================================================
+// Milliseconds since power up
+
+uint32_t GetUptime(void)
+{
+	uint32_t ms;
+	uint16_t counts;
+
+	cli();
+	ms = uptime;
+	counts = TCNT1;
+	if (TimerWrapped(counts))
+	{
+		ms += SLOT_MS;
+	}
+	sei();
+
+	return ms + counts / (TIMER1_PERIOD / SLOT_MS);
+}
+
+//==============================================================================================================================
+// Control ticks per second, one of 2, 4, 5 or 10. Returns false for anything else. Only change it between runs, the
+// stage handlers and the PID are set up for the rate a run starts at.
+
+bool setControlRate(uint8_t hz)
+{
+	if ((hz != 2) && (hz != 4) && (hz != 5) && (hz != 10))
+	{
+		return false;
+	}
+	controlRate = hz;
+	controlPeriod = 1000 / hz;
+	tickSlots = 100 / hz;
+	return true;
+}
+
+//==============================================================================================================================
+// Take the oldest waiting event, returns 0 if there is none
+
+static uint8_t GetEvent(CONTROL_EVENT *event)
+{
+	uint8_t tail = eventTail;
+	uint8_t depth = eventHead - tail;
+
+	if (depth == 0)
+	{
+		return 0;
+	}
+	if (depth > eventDepthMax)
+	{
+		eventDepthMax = depth;
+	}
+	*event = eventQueue[tail & EVENT_QUEUE_MASK];
+	eventTail = tail + 1; // Only release the slot once it has been copied
+	return 1;
+}
+
+//==============================================================================================================================
+// Whether the timer has queued events that ControlTask has not handled yet
+
+bool ControlPending(void)
+{
+	return (eventHead != eventTail);
+}
+
+//==============================================================================================================================
+// Drop everything the interrupts have queued and clear the counters, for when the main loop has been away on purpose
+
+void FlushEvents(void)
+{
+	SPI_SAMPLE sample;
+	uint32_t now;
+
+	cli();
+	eventTail = eventHead;
+	now = timerBase + TIMER1_PERIOD;
+	eventOverruns = 0;
+	spiOverruns = 0;
+	sei();
+
+	while (spi_get_sample(&sample, now));
+	eventDepthMax = 0;
+	overrunsReported = 0;
+}
+
+//==============================================================================================================================
+// Report the event and sample overruns and the deepest the event queue has been
+
+void SendLoopStats(void)
+{
+	fprintf_P(&USBSerialStream, PSTR("=STATS,%u,%u,%u\n"), eventOverruns, spiOverruns, eventDepthMax);
+}
+
+//==============================================================================================================================
+// Push the last half second into the temperature history
+
+void UpdateHistory (void)
+{
+	if (historyReadings)
+	{
+		HistoryPush(&ovenTempHistory, historyAccum / historyReadings);
+	}
+	historyAccum = 0;
+	historyReadings = 0;
+
+	ovenDelta4 = HistoryDelta(&ovenTempHistory, 0);
+	ovenDelta16 = HistoryDelta(&ovenTempHistory, 1);
+	ovenDelta32 = HistoryDelta(&ovenTempHistory, 2);
+
+	HistoryPush(&ovenDelta4History, ovenDelta4);
+	ovenRateOfChange = HistoryDelta(&ovenDelta4History, 0);
+}
+
+//==============================================================================================================================
+// Send a temperature packet as a binary record. A faulted reading sends zero for the fields the CSV line leaves out.
+
+static void SendSample (void)
+{
+	TELEMETRY_SAMPLE_RECORD record;
+	bool fault = (ovenTemp >= 65533);
+
+	record.Type = TELEMETRY_SAMPLE;
+	record.Stage = ovenStage;
+	record.Time = (uint32_t)count * controlPeriod;
+	record.Temp = ovenTemp;
+	record.Duty = fault ? 0 : duty_cycle;
+	record.Delta4 = fault ? 0 : ovenDelta4;
+	record.Delta16 = fault ? 0 : ovenDelta16;
+	record.Delta32 = fault ? 0 : ovenDelta32;
+	record.Rate = fault ? 0 : ovenRateOfChange;
+	record.Error = fault ? 0 : ovenError;
+	record.Junction = ovenJunction;
+	record.Faults = ovenFaults;
+	TelemetrySend(&USBSerialStream, &record, sizeof(record));
+}
+
+//==============================================================================================================================
+// Send a temperature packet
+
+void UpdateTemp (void)
+{
+	char str[20];
+
+	if (readings)
+	{
+		ovenTemp = ovenTempAccum / readings;
+		ovenJunction = ovenJunctionAccum / readings;
+	}
+	ovenTempAccum = 0;
+	ovenJunctionAccum = 0;
+	readings = 0;
+	ovenFaults = ovenFaultsAccum;
+	ovenFaultsAccum = 0;
+
+	if (lcdPresent)
+	{
+		lcd_gotoxy(10, 0);
+	}
+
+	if (ovenTemp >= 65533) // The safety supervisor has already cut the heater
+	{
+		if (ovenTemp == 65535)
+		{
+			sprintf_P (str, PSTR("No TC "));
+		}
+		else if (ovenTemp == 65534)			
+		{
+			sprintf_P (str, PSTR("SG Err"));
+		}
+		else
+		{
+			sprintf_P (str, PSTR("SV Err"));
+		}
+		if ((lcdPresent) && (showTemp))
+		{
+			lcd_puts (str);
+		}		
+		if (telemetryMode == TELEMETRY_CSV)
+		{
+			fprintf_P (&USBSerialStream, PSTR("%u,%lu,%s, %d,%u\n"), ovenStage, (unsigned long)count * controlPeriod, str, ovenJunction, ovenFaults);
+		}
+	}
+	else
+	{
+		sprintf_P (str, PSTR("%3u.%02u"), ovenTemp>>2, (ovenTemp & 0x03)*25);
+		if ((lcdPresent) && (showTemp))
+		{
+			lcd_puts (str);
+		}
+		if (telemetryMode == TELEMETRY_CSV)
+		{
+			fprintf_P (&USBSerialStream, PSTR("%u,%lu,%s,%u, %d,%d,%d, %d,%d, %d,%u\n"), ovenStage, (unsigned long)count * controlPeriod, str, duty_cycle, ovenDelta4, ovenDelta16, ovenDelta32, ovenRateOfChange, ovenError, ovenJunction, ovenFaults);
+		}
+	}
+
+	if (telemetryMode == TELEMETRY_BINARY)
+	{
+		SendSample();
+	}
+
+	count++;
+}
+
+//==============================================================================================================================
+//
+
+void setDutyCycle (uint8_t ratio)
+{
+	setDutyCycleFine((uint16_t)ratio << 8);
+}
+
+//==============================================================================================================================
+// Heater duty in 1/256 percent. Written to the buffer the ISR isn't reading and then swapped, so the ISR picks it up
+// whole at its next slot.
+
+void setDutyCycleFine (uint16_t duty)
+{
+	if (duty > DUTY_FULL)
+	{
+		duty = DUTY_FULL;
+	}
+	duty_cycle = (duty + 0x80) >> 8;
+	dutyBuffer[dutyIndex ^ 1] = duty;
+	dutyIndex ^= 1;
+	if (duty == 0)
+	{
+		SSR_OFF;
+	}
+}
+
+//==============================================================================================================================
+// Close the EMR, the SSR is held off until the contacts have settled. Returns straight away, the timer finishes it.
+
+void HeaterOn(void)
+{
+	cli();
+	if ((!safetyTrip) && ((heaterState == HEATER_OFF) || (heaterState == HEATER_DISARMING)))
+	{
+		SSR_OFF;
+		EMR_ON;
+		heaterState = HEATER_ARMING;
+		heaterDwell = HEATER_DWELL_SLOTS;
+	}
+	sei();
+}
+
+//==============================================================================================================================
+// Turn the SSR off now and open the EMR once it has stopped conducting. Safe to call from anywhere, any number of times.
+
+void HeaterOff(void)
+{
+	setDutyCycle(0);
+	cli();
+	if ((heaterState == HEATER_ARMING) || (heaterState == HEATER_ON))
+	{
+		heaterState = HEATER_DISARMING;
+		heaterDwell = HEATER_DWELL_SLOTS;
+	}
+	sei();
+}
+
+//==============================================================================================================================
+// Mains frequency measured by the zero-cross, 0 when the SSR is running off the timer
+
+uint8_t getMainsFrequency(void)
+{
+	uint16_t period = zcPeriod;
+
+	if (zcLock != ZC_LOCK_EDGES)
+	{
+		return 0;
+	}
+	return (62500UL + (period >> 1)) / period;
+}
+
+//==============================================================================================================================
+// Copy FinalTemps into the duty map, skipping uncalibrated steps and any that don't rise. Call before a run uses
+// getDutyCycle, the calibration may have changed since the last one.
+
+void loadDutyMap(void)
+{
+	uint8_t i;
+	uint16_t temp;
+
+	dutyMapTemps[0] = DUTY_MAP_AMBIENT;
+	dutyMapDuty[0] = 0;
+	dutyMapCount = 1;
+	for (i = 0; i < 20; i++)
+	{
+		temp = eeprom_read_word(&FinalTemps[i]) << 2;
+		if (temp > dutyMapTemps[dutyMapCount - 1])
+		{
+			dutyMapTemps[dutyMapCount] = temp;
+			dutyMapDuty[dutyMapCount] = (i + 1) * 5;
+			dutyMapCount++;
+		}
+	}
+}
+
+//==============================================================================================================================
+// Duty (Q16.16 percent) that holds the oven at temp (0.25c steps), interpolated between the calibration points and held
+// at the top one above them
+
+int32_t getDutyCycle(uint16_t temp)
+{
+	uint8_t lo = 0;
+	uint8_t hi = dutyMapCount - 1;
+	uint8_t mid;
+
+	if (temp >= dutyMapTemps[hi])
+	{
+		return (int32_t)dutyMapDuty[hi] << 16;
+	}
+	if (temp <= dutyMapTemps[0])
+	{
+		return 0;
+	}
+
+	// dutyMapTemps[lo] < temp < dutyMapTemps[hi]
+	while (hi - lo > 1)
+	{
+		mid = (lo + hi) >> 1;
+		if (temp < dutyMapTemps[mid])
+		{
+			hi = mid;
+		}
+		else
+		{
+			lo = mid;
+		}
+	}
+
+	return ((int32_t)dutyMapDuty[lo] << 16) +
+		(int32_t)(((uint32_t)(temp - dutyMapTemps[lo]) << 16) / (dutyMapTemps[hi] - dutyMapTemps[lo])) * (dutyMapDuty[hi] - dutyMapDuty[lo]);
+}
+
+//==============================================================================================================================
+//
+
+void printProfile (void)
+{
+	fprintf (&USBSerialStream, "=RUN,%s,%u,%u,%u,%u,%u,%u,%u,%u\n",
+		profile.name, profile.preheat_temp, profile.soak_dutycycle*5, profile.soak_temp, profile.reflow_time, profile.reflow_temp, profile.calibrated,
+		profile.preheat_cutoff, profile.reflow_cutoff);
+}
+
+//==============================================================================================================================
+// Move the profile setpoint toward target at PROFILE_RAMP_RATE, holding it while the oven is more than
+// PROFILE_MAX_LEAD behind
+
+static void RampSetpoint(uint16_t target)
+{
+	if (ovenSetpoint > target)
+	{
+		ovenSetpoint = target; // Oven started out warm
+	}
+	else if ((ovenSetpoint < target) && (ovenSetpoint < ovenTemp + PROFILE_MAX_LEAD))
+	{
+		uint8_t step;
+
+		rampAccum += PROFILE_RAMP_RATE / controlRate;
+		step = rampAccum >> 8;
+		rampAccum &= 0xFF;
+		ovenSetpoint = (target - ovenSetpoint > step) ? ovenSetpoint + step : target;
+	}
+}
+
+//==============================================================================================================================
+// The setpoint has reached target and the oven is within PROFILE_BAND of it
+
+static bool SetpointReached(uint16_t target)
+{
+	return (ovenSetpoint == target) && (ovenTemp + PROFILE_BAND >= target);
+}
+
+//==============================================================================================================================
+// Drive the heater to follow ovenSetpoint, the FinalTemps duty for the setpoint is the feedforward and the PID trims it
+
+static void TrackSetpoint(void)
+{
+	ovenError = (int16_t)(ovenTemp - ovenSetpoint);
+	pid.ff = getDutyCycle(ovenSetpoint);
+	PIDController_Update(&pid, ovenSetpoint, ovenTemp);
+	setDutyCycleFine(pid.outFine);
+}
+
+//==============================================================================================================================
+// Move on to the stage at stageIndex, its label goes up straight away and Enter waits for the next pass
+
+static void StageShow(void)
+{
+	PGM_P label;
+
+	memcpy_P(&label, &stageTable[stageIndex].Label, sizeof(PGM_P));
+	ovenStage = pgm_read_byte(&stageTable[stageIndex].Stage);
+	stageEntered = false;
+	if (label)
+	{
+		lcd_gotoxy(0, 1);
+		lcd_puts_p(label);
+	}
+}
+
+//==============================================================================================================================
+// Start a run from its stage table, with a title on the top line if there is one
+
+static void StageStart(const STAGE *stages, PGM_P title)
+{
+	lcd_gotoxy(0, 1);
+	lcd_puts_P("                ");
+	if (title)
+	{
+		lcd_gotoxy(0, 0);
+		lcd_puts_p(title);
+	}
+	showTemp = true;
+	count = 0;
+	stageTable = stages;
+	stageIndex = 0;
+	StageShow();
+	ProcessHandler = StageHandler;
+	isRunning = true;
+}
+
+//==============================================================================================================================
+// Turn the oven off and go back to idle, for the end of a run and for a safety trip
+
+static void StageStop(void)
+{
+	HeaterOff(); //Turn off the SSR and then the EMR
+	isRunning = false;
+	ovenStage = 0;
+	stageHostStart = false;
+	SetIdleMode();
+}
+
+//==============================================================================================================================
+// End the run, an action can call this to finish early
+
+static void StageEnd(void)
+{
+	fprintf(&USBSerialStream, "=END\n");
+	StageStop();
+}
+
+//==============================================================================================================================
+// Start a run for the host with one of the *Command functions. No one is at the panel to press ENTER once the door is
+// closed, the host starting it stands in for that.
+
+void HostStart(void (*command)(void))
+{
+	command();
+	stageHostStart = true;
+}
+
+//==============================================================================================================================
+// Stage engine. Every run is a PROGMEM table of STAGEs and this is the ProcessHandler for all of them. A pass runs the
+// stage's Enter the first time, then Run, then leaves through Exit once the Guard holds or the Timeout runs out. The
+// next stage's label goes up as it is left and the rest waits for the following pass, the last one ends the run with
+// =END.
+
+static void StageHandler(void)
+{
+	STAGE stage;
+	bool leave;
+
+	if (safetyTrip) // The supervisor has already cut the heater, leave it off until SafetyService ends the run
+	{
+		return;
+	}
+
+	memcpy_P(&stage, &stageTable[stageIndex], sizeof(STAGE));
+	stageArg = stage.Arg;
+
+	if (!stageEntered)
+	{
+		stageEntered = true;
+		stageTicks = 0;
+		if (stage.Enter)
+		{
+			stage.Enter();
+			if (!isRunning)
+			{
+				return;
+			}
+		}
+	}
+
+	if ((stage.Flags & STAGE_TICK) && (!tick))
+	{
+		return;
+	}
+
+	if (stage.Run)
+	{
+		stage.Run();
+	}
+
+	if (stage.Guard)
+	{
+		leave = stage.Guard();
+	}
+	else
+	{
+		leave = (stage.Timeout == 0); // Nothing to wait for
+	}
+	if ((!leave) && (stage.Timeout) && (tick) && (++stageTicks >= TICKS(stage.Timeout)))
+	{
+		leave = true;
+	}
+	if (!leave)
+	{
+		return;
+	}
+
+	if (stage.Exit)
+	{
+		stage.Exit();
+		if (!isRunning)
+		{
+			return;
+		}
+	}
+	if (stage.Flags & STAGE_LAST)
+	{
+		StageEnd();
+		return;
+	}
+	stageIndex++;
+	StageShow();
+}
+
+//==============================================================================================================================
+// Guards shared by the runs
+
+// The door stage takes a host start as the ENTER press
+static bool EnterPressed(void)
+{
+	if (stageHostStart)
+	{
+		stageHostStart = false;
+		return true;
+	}
+	return ((newButton) && (buttons == EVENT_ENTER_BUTTON_PUSHED));
+}
+
+// The oven has reached the stage's Arg in c
+static bool StageAtTemp(void)
+{
+	return (ovenTemp >= ((uint16_t)stageArg << 2));
+}
+
+// Runs until it is aborted
+static bool StageHold(void)
+{
+	return false;
+}
+
+//==============================================================================================================================
+// Reflow profile run. The setpoint ramps to the preheat temp, ramps across the soak to the soak temp over the soak time
+// and ramps to the reflow temp, the reflow time runs from the end of the soak.
+
+static void RunStart(void)
+{
+	__pidParams params;
+
+	printProfile(); // Send the profile we are about to run to the serial port
+	count = 0;
+	eeprom_read_block((void*)&params, (const void*)&PidParams, sizeof(__pidParams));
+	pid.Kp = params.Kp;
+	pid.Ki = params.Ki;
+	pid.Kd = params.Kd;
+	pid.limMin = PID_Q16(0.0);
+	pid.limMax = PID_Q16(100.0);
+	pid.limMinInt = PID_Q16(-20.0);
+	pid.limMaxInt = PID_Q16(20.0);
+	pid.T = PID_Q16(1.0) / controlRate;
+	pid.tau = params.tau;
+	PIDController_Init(&pid);
+	loadDutyMap();
+	ovenSetpoint = ovenTemp;
+	rampAccum = 0;
+	HeaterOn(); //Turn on the EMR, the SSR follows
+}
+
+static void RunPreheat(void)
+{
+	RampSetpoint((uint16_t)profile.preheat_temp << 2);
+	TrackSetpoint();
+}
+
+static bool RunPreheatDone(void)
+{
+	return SetpointReached((uint16_t)profile.preheat_temp << 2);
+}
+
+static void RunSoakStart(void)
+{
+	ovenCounter = 0;
+}
+
+static void RunSoak(void)
+{
+	ovenCounter++;
+	ovenSetpoint = SoakSetpoint(profile.preheat_temp, profile.soak_temp, ovenCounter, TICKS(profile.soak_time));
+	TrackSetpoint();
+}
+
+static bool RunSoakDone(void)
+{
+	return (ovenCounter >= TICKS(profile.soak_time));
+}
+
+static void RunSoakEnd(void)
+{
+	ovenCounter = count;
+}
+
+static void RunReflow(void)
+{
+	RampSetpoint((uint16_t)profile.reflow_temp << 2);
+	TrackSetpoint();
+}
+
+static bool RunReflowDone(void)
+{
+	return SetpointReached((uint16_t)profile.reflow_temp << 2);
+}
+
+static bool RunDwellDone(void)
+{
+	return ((count - ovenCounter) >= TICKS(profile.reflow_time));
+}
+
+static void RunBeep(void)
+{
+	BuzzerPlay(BEEP_RUN_END);
+}
+
+static bool RunCool(void)
+{
+	return ((ovenTemp >> 2) < 100);
+}
+
+const char StageCloseDoor[] PROGMEM = "Close door      ";
+const char RunLabel2[] PROGMEM = "Preheat         ";
+const char RunLabel5[] PROGMEM = "Soak            ";
+const char RunLabel6[] PROGMEM = "Reflow          ";
+const char RunLabel8[] PROGMEM = "Dwell         ";
+const char RunLabel9[] PROGMEM = "Open door    ";
+
+const STAGE RunProfileStages[] PROGMEM =
+{
+	STAGE_CLOSE_DOOR,
+	{2, 0, 0, 0, RunLabel2, RunStart, NULL, NULL, NULL},
+	{3, STAGE_TICK, 0, 0, NULL, NULL, RunPreheat, RunPreheatDone, NULL},
+	{5, STAGE_TICK, 0, 0, RunLabel5, RunSoakStart, RunSoak, RunSoakDone, RunSoakEnd},
+	{6, STAGE_TICK, 0, 0, RunLabel6, NULL, RunReflow, RunReflowDone, NULL},
+	{8, STAGE_TICK, 0, 0, RunLabel8, NULL, TrackSetpoint, RunDwellDone, HeaterOff},
+	{9, STAGE_TICK, 10, 0, RunLabel9, RunBeep, NULL, NULL, NULL},					// Ten seconds of beeping
+	{9, STAGE_TICK | STAGE_LAST, 0, 0, NULL, NULL, NULL, RunCool, NULL}			// then wait for 100c
+};
+
+void RunProfileCommand()
+{
+	StageStart(RunProfileStages, NULL);
+};
+
+//==============================================================================================================================
+// Step calibration. Full power until the oven rises fast, then the stage's duty until the temperature settles, from 5%
+// up to 50% or until the oven is over 250c.
+
+static bool OCALStageDone(void)
+{
+	if ((ovenDelta32 == 0) && (count >= TICKS(300)))
+	{
+		deltaCount++;
+		if ((deltaCount == 10) && (!endSet))
+		{
+			endCount = (count >= TICKS(600)) ? count+TICKS(300) : TICKS(900);
+			endSet = 1;
+		}
+	}
+	else
+	{
+		deltaCount = 0;
+	}
+	
+	if (count == endCount)
+	{
+		endCount = TICKS(1800);
+		endSet = 0;
+		deltaCount = 0;
+		return true;
+	}
+	
+	return false;
+}
+
+//==============================================================================================================================
+//
+
+static void OCALStart(void)
+{
+	fprintf (&USBSerialStream, "=OCAL\n");
+	count = 0;
+	HeaterOn(); //Turn on the EMR, the SSR follows
+	setDutyCycle(100); //Turn on the SSR at 100%
+	endCount = TICKS(1800);
+	endSet = 0;
+}
+
+static void OCALStep(void)
+{
+	if ((duty_cycle == 100) && (ovenDelta4 >= 63))
+	{
+		setDutyCycle(stageArg);
+	}
+}
+
+static void OCALEnd(void)
+{
+	count = 0;
+	endCount = TICKS(1800);
+	endSet = 0;
+}
+
+static void OCALIsDone(void)
+{
+	if (ovenTemp > 1000)
+	{
+		OCALEnd();
+		StageEnd();
+	}
+	else
+	{
+		count = 0;
+		setDutyCycle(100); //Turn on the SSR at 100%
+	}
+}
+
+const char OCALTitle[] PROGMEM = "Oven Cal ";
+const char OCALLabel2[] PROGMEM = "5%            ";
+const char OCALLabel4[] PROGMEM = "10%   ";
+const char OCALLabel5[] PROGMEM = "15%   ";
+const char OCALLabel6[] PROGMEM = "20%   ";
+const char OCALLabel7[] PROGMEM = "25%   ";
+const char OCALLabel8[] PROGMEM = "30%   ";
+const char OCALLabel9[] PROGMEM = "35%   ";
+const char OCALLabel10[] PROGMEM = "40%   ";
+const char OCALLabel11[] PROGMEM = "45%   ";
+const char OCALLabel12[] PROGMEM = "50%   ";
+
+const STAGE CalibrateOvenStages[] PROGMEM =
+{
+	STAGE_CLOSE_DOOR,
+	{2, 0, 0, 0, OCALLabel2, OCALStart, NULL, NULL, NULL},
+	{3, STAGE_TICK, 0, 5, NULL, NULL, OCALStep, OCALStageDone, OCALIsDone},
+	{4, STAGE_TICK, 0, 10, OCALLabel4, NULL, OCALStep, OCALStageDone, OCALIsDone},
+	{5, STAGE_TICK, 0, 15, OCALLabel5, NULL, OCALStep, OCALStageDone, OCALIsDone},
+	{6, STAGE_TICK, 0, 20, OCALLabel6, NULL, OCALStep, OCALStageDone, OCALIsDone},
+	{7, STAGE_TICK, 0, 25, OCALLabel7, NULL, OCALStep, OCALStageDone, OCALIsDone},
+	{8, STAGE_TICK, 0, 30, OCALLabel8, NULL, OCALStep, OCALStageDone, OCALIsDone},
+	{9, STAGE_TICK, 0, 35, OCALLabel9, NULL, OCALStep, OCALStageDone, OCALIsDone},
+	{10, STAGE_TICK, 0, 40, OCALLabel10, NULL, OCALStep, OCALStageDone, OCALIsDone},
+	{11, STAGE_TICK, 0, 45, OCALLabel11, NULL, OCALStep, OCALStageDone, OCALIsDone},
+	{12, STAGE_TICK | STAGE_LAST, 0, 50, OCALLabel12, NULL, OCALStep, OCALStageDone, OCALEnd}
+};
+
+void CalibrateOvenCommand()
+{
+	StageStart(CalibrateOvenStages, OCALTitle);
+};
+
+//==============================================================================================================================
+// One run oven calibration. The oven is heated at full power to IDENT_TOP and left to cool, the rise and fall rates are
+// sampled every 16c. Treating the elements and cavity as one first order lump with a temperature dependent loss, the
+// rise rate is full power less the loss and the fall rate is the loss, so the duty that holds a temperature is
+// fall / (rise + fall). Where the cooling doesn't reach (low down) the loss is full power less the rise.
+//==============================================================================================================================
+// Temperature the last ovenDelta32 is centred on, it covers the previous 32 seconds
+
+static uint16_t IdentCentreTemp(void)
+{
+	return ovenTemp - (ovenDelta32 >> 3);
+}
+
+//==============================================================================================================================
+// Work out FinalTemps, TempCounts and OvenModel from the rates. Returns false if there weren't enough of them.
+
+static bool IdentifyOvenFit(void)
+{
+	__ovenModel model;
+	int32_t full = 0;
+	uint16_t temps[IDENT_BINS + 1];
+	int16_t loss[IDENT_BINS + 1];
+	uint16_t duty[IDENT_BINS + 1]; // 0.1% steps
+	uint8_t pairs = 0;
+	uint8_t points;
+	uint8_t i, k;
+
+	// Full power rate from the bins that have both
+	for (k = 0; k < IDENT_BINS; k++)
+	{
+		if ((identHeat[k] > 0) && (identCool[k] > 0))
+		{
+			full += identHeat[k] + identCool[k];
+			pairs++;
+		}
+	}
+	if (pairs == 0)
+	{
+		return false;
+	}
+	full /= pairs;
+
+	// Loss and holding duty at each bin, starting from no loss at the temperature the run started at. A rise that is
+	// still getting quicker is the elements warming up and says nothing about the loss. Both have to go up from one point
+	// to the next, the duty is coarser than the loss and two bins can round to the same one.
+	temps[0] = ovenEndTemp;
+	loss[0] = 0;
+	duty[0] = 0;
+	points = 1;
+	for (k = 0; k < IDENT_BINS; k++)
+	{
+		int16_t l;
+		uint16_t d;
+
+		if (identCool[k] > 0)
+		{
+			l = identCool[k];
+		}
+		else if ((identHeat[k] > 0) && ((k + 1 == IDENT_BINS) || (identHeat[k] >= identHeat[k + 1])))
+		{
+			l = full - identHeat[k];
+		}
+		else
+		{
+			continue;
+		}
+		d = ((int32_t)l * 1000) / full;
+		if ((l > loss[points - 1]) && (d > duty[points - 1]))
+		{
+			temps[points] = IDENT_BIN_FIRST + ((uint16_t)k << IDENT_BIN_SHIFT);
+			loss[points] = l;
+			duty[points] = d;
+			points++;
+		}
+	}
+
+	if (points < 3)
+	{
+		return false;
+	}
+
+	// Temperature for each 5% step, between the points either side or carried on from the top two up to the over
+	// temperature trip. TempCounts is the time constant there in 8 second steps, the reciprocal of the slope of the loss.
+	// Steps out of reach are left at 0 like an uncalibrated one.
+	for (i = 0; i < 20; i++)
+	{
+		uint16_t target = (i + 1) * 50;
+		uint16_t temp;
+		uint16_t counts;
+
+		for (k = 1; (k < points - 1) && (duty[k] < target); k++)
+		{
+		}
+		temp = temps[k - 1] + (uint16_t)(((uint32_t)(target - duty[k - 1]) * (temps[k] - temps[k - 1])) / (duty[k] - duty[k - 1]));
+		counts = ((uint32_t)(temps[k] - temps[k - 1]) << 4) / (loss[k] - loss[k - 1]);
+		if (temp > IDENT_LIMIT)
+		{
+			temp = 0;
+			counts = 0;
+		}
+		eeprom_update_word(&FinalTemps[i], temp >> 2);
+		eeprom_update_byte(&TempCounts[i], (counts > 255) ? 255 : counts);
+	}
+
+	model.identified = 1;
+	model.deadTime = ((ovenCounter << 1) / controlRate > 255) ? 255 : (ovenCounter << 1) / controlRate;
+	model.fullRate = full;
+	eeprom_update_block((const void*)&model, (void*)&OvenModel, sizeof(__ovenModel));
+	eeprom_update_byte(&OvenCalibrated, 1);
+
+	fprintf_P(&USBSerialStream, PSTR("=IDENT,%u,%u"), model.deadTime, model.fullRate);
+	for (i = 0; i < 20; i++)
+	{
+		fprintf_P(&USBSerialStream, PSTR(",%u"), eeprom_read_word(&FinalTemps[i]));
+	}
+	fputc('\n', &USBSerialStream);
+
+	return true;
+}
+
+//==============================================================================================================================
+//
+
+static void IdentStart(void)
+{
+	fprintf (&USBSerialStream, "=OCAL\n");
+	count = 0;
+	HeaterOn(); //Turn on the EMR, the SSR follows
+	setDutyCycle(100); //Turn on the SSR at 100%
+	memset(identHeat, 0, sizeof(identHeat));
+	memset(identCool, 0, sizeof(identCool));
+	identNext = 0;
+	ovenEndTemp = ovenTemp;
+	ovenCounter = 0;
+}
+
+// Heat, rates are only kept once ovenDelta32 covers the run
+static void IdentHeat(void)
+{
+	uint16_t centre = IdentCentreTemp();
+
+	if ((ovenCounter == 0) && (ovenTemp >= ovenEndTemp + 4))
+	{
+		ovenCounter = count; // Dead time, until it has risen 1c
+	}
+	while ((identNext < IDENT_BINS) && (centre >= IDENT_BIN_FIRST + ((uint16_t)identNext << IDENT_BIN_SHIFT)))
+	{
+		if (count > TICKS(IDENT_PRIMED))
+		{
+			identHeat[identNext] = ovenDelta32;
+		}
+		identNext++;
+	}
+}
+
+static void IdentHeatEnd(void)
+{
+	setDutyCycle(0); //Turn off the SSR
+	endCount = count + TICKS(IDENT_SETTLE);
+}
+
+// Let the elements and the cavity come together
+static bool IdentSettled(void)
+{
+	return (count >= endCount);
+}
+
+static void IdentCoolStart(void)
+{
+	uint16_t centre = IdentCentreTemp();
+
+	identNext = IDENT_BINS;
+	while ((identNext > 0) && (centre <= IDENT_BIN_FIRST + ((uint16_t)(identNext - 1) << IDENT_BIN_SHIFT)))
+	{
+		identNext--;
+	}
+}
+
+// Cool, identNext is the bin above the next one down
+static void IdentCool(void)
+{
+	uint16_t centre = IdentCentreTemp();
+
+	while ((identNext > 0) && (centre <= IDENT_BIN_FIRST + ((uint16_t)(identNext - 1) << IDENT_BIN_SHIFT)))
+	{
+		identNext--;
+		identCool[identNext] = -ovenDelta32;
+	}
+}
+
+static bool IdentCooled(void)
+{
+	return ((IdentCentreTemp() < IDENT_COOL_END) || (count >= TICKS(IDENT_TIMEOUT)));
+}
+
+// Fit and save
+static void IdentFinish(void)
+{
+	lcd_gotoxy(0, 1);
+	if (IdentifyOvenFit())
+	{
+		lcd_puts_P("Calibrated     ");
+	}
+	else
+	{
+		lcd_puts_P("Cal. failed    ");
+	}
+	endCount = TICKS(1800);
+}
+
+const char IdentLabel2[] PROGMEM = "Heating        ";
+const char IdentLabel4[] PROGMEM = "Cooling        ";
+
+const STAGE IdentifyOvenStages[] PROGMEM =
+{
+	STAGE_CLOSE_DOOR,
+	{2, 0, 0, 0, IdentLabel2, IdentStart, NULL, NULL, NULL},
+	{3, STAGE_TICK, 0, IDENT_TOP >> 2, NULL, NULL, IdentHeat, StageAtTemp, IdentHeatEnd},
+	{4, STAGE_TICK, 0, 0, IdentLabel4, NULL, NULL, IdentSettled, IdentCoolStart},
+	{5, STAGE_TICK, 0, 0, NULL, NULL, IdentCool, IdentCooled, NULL},
+	{6, STAGE_LAST, 0, 0, NULL, IdentFinish, NULL, NULL, NULL}
+};
+
+void IdentifyOvenCommand()
+{
+	StageStart(IdentifyOvenStages, OCALTitle);
+};
+
+//==============================================================================================================================
+// Proportional only hold at 60c for checking the loop by hand
+
+static void PIDTestStart(void)
+{
+	fprintf (&USBSerialStream, "=OPIDTEST\n");
+	HeaterOn(); //Turn on the EMR, the SSR follows
+}
+
+static void PIDTestStep(void)
+{
+	PIDController_Update(&pid, 60 << 2, ovenTemp);
+//	fprintf_P (&USBSerialStream, PSTR("#,%.2f,%.2f,%.2f\n"), pid.proportional, pid.integrator, pid.differentiator);
+	ovenError = pid.prevError;
+	setDutyCycle(pid.out);
+}
+
+const char PIDTestTitle[] PROGMEM = "PID Test";
+
+const STAGE PIDTestStages[] PROGMEM =
+{
+	{0, 0, 0, 0, NULL, PIDTestStart, NULL, NULL, NULL},
+	{3, STAGE_TICK | STAGE_LAST, 0, 0, NULL, NULL, PIDTestStep, StageHold, NULL}
+};
+
+void PIDTestCommand()
+{
+/*
+	pid.Kp = PID_Q16(0.75);  // 7.0 == oscillate a bit
+	pid.Ki = PID_Q16(0.0); // 0.003; // 0.03;
+	pid.Kd = PID_Q16(0.0); // 1.0; // 42;
+	pid.limMin = PID_Q16(0.0);
+	pid.limMax = PID_Q16(100.0);
+	pid.limMinInt = PID_Q16(-1.0);
+	pid.limMaxInt = PID_Q16(1.0);
+	pid.T = PID_Q16(0.5);
+	pid.tau = PID_Q16(90.0);
+*/
+	pid.Kp = PID_Q16(2);  // 7.0 == oscillate a bit
+	pid.Ki = PID_Q16(0.0); // 0.003; // 0.03;
+	pid.Kd = PID_Q16(0.0); // 1.0; // 42;
+	pid.limMin = PID_Q16(0.0);
+	pid.limMax = PID_Q16(10.0);
+	pid.limMinInt = PID_Q16(-1.0);
+	pid.limMaxInt = PID_Q16(1.0);
+	pid.T = PID_Q16(1.0) / controlRate;
+	pid.tau = PID_Q16(90.0);
+	
+	PIDController_Init(&pid);
+	
+	StageStart(PIDTestStages, PIDTestTitle);
+};
+
+//==============================================================================================================================
+// Heat to a temperature, cut the heat and record how far the oven coasts, the 60c and 120c calibrations
+
+static void CalMark(void)
+{
+	endCount = count;
+}
+
+static void CalCutoff(void)
+{
+	setDutyCycle(0); //Turn off the SSR
+	endCount = count-endCount;
+	ovenEndTemp = ovenTemp;
+}
+
+// Wait for delta4 to get to 0
+static bool CalSettled(void)
+{
+	return (ovenDelta4 <= 0);
+}
+
+static void Cal60Start(void)
+{
+	fprintf (&USBSerialStream, "=O60\n");
+	count = 0;
+	HeaterOn(); //Turn on the EMR, the SSR follows
+	setDutyCycle(20); //Turn on the SSR at 20%
+}
+
+static void Cal60Mark(void)
+{
+	CalMark();
+	setDutyCycle(5); //Turn on the SSR at 5%
+}
+
+const char Cal60Title[] PROGMEM = "Oven 60c";
+const char Cal60Label2[] PROGMEM = "20%           ";
+const char Cal60Label4[] PROGMEM = "5% @50c    ";
+const char Cal60Label5[] PROGMEM = "60c cutoff";
+
+const STAGE Calibrate60cStages[] PROGMEM =
+{
+	STAGE_CLOSE_DOOR,
+	{2, 0, 0, 0, Cal60Label2, Cal60Start, NULL, NULL, NULL},
+	{3, 0, 0, 50, NULL, NULL, NULL, StageAtTemp, Cal60Mark},
+	{4, 0, 0, 60, Cal60Label4, NULL, NULL, StageAtTemp, CalCutoff},
+	{5, STAGE_LAST, 0, 0, Cal60Label5, NULL, NULL, CalSettled, NULL}
+};
+
+void Calibrate60cCommand()
+{
+	StageStart(Calibrate60cStages, Cal60Title);
+};
+
+//==============================================================================================================================
+//
+
+static void Cal120Start(void)
+{
+	fprintf (&USBSerialStream, "=O120\n");
+	count = 0;
+	HeaterOn(); //Turn on the EMR, the SSR follows
+	setDutyCycle(20); //Turn on the SSR at 20%
+}
+
+const char Cal120Title[] PROGMEM = "Oven 120c";
+const char Cal120Label2[] PROGMEM = "100%          ";
+const char Cal120Label4[] PROGMEM = "100% @100c    ";
+const char Cal120Label5[] PROGMEM = "120c cutoff";
+
+const STAGE Calibrate120cStages[] PROGMEM =
+{
+	STAGE_CLOSE_DOOR,
+	{2, 0, 0, 0, Cal120Label2, Cal120Start, NULL, NULL, NULL},
+	{3, 0, 0, 100, NULL, NULL, NULL, StageAtTemp, CalMark},
+	{4, 0, 0, 120, Cal120Label4, NULL, NULL, StageAtTemp, CalCutoff},
+	{5, STAGE_LAST, 0, 0, Cal120Label5, NULL, NULL, CalSettled, NULL}
+};
+
+void Calibrate120cCommand()
+{
+	StageStart(Calibrate120cStages, Cal120Title);
+};
+
+//==============================================================================================================================
+// Relay feedback autotune (Astrom-Hagglund). The oven is held around AUTOTUNE_SETPOINT by switching the heater between
+// bias +/- step, the oscillation that builds up gives the ultimate gain and period and the PID gains are worked out
+// from those and saved in PidParams for the profile engine.
+//==============================================================================================================================
+// Q16.16 to thousandths for reporting, printf has no float support
+
+static long Q16Milli(int32_t q)
+{
+	return ((q >> 6) * 1000) >> 10;
+}
+
+//==============================================================================================================================
+//
+
+static void TuneStart(void)
+{
+	fprintf (&USBSerialStream, "=ATUNE\n");
+	count = 0;
+	HeaterOn(); //Turn on the EMR, the SSR follows
+	setDutyCycle(100); //Turn on the SSR at 100%
+}
+
+// At the setpoint, the relay swings either side of the calibrated duty for it
+static void TuneRelayStart(void)
+{
+	loadDutyMap();
+	tuneBias = (getDutyCycle(AUTOTUNE_SETPOINT) + 0x8000) >> 16;
+	if (tuneBias == 0)
+	{
+		tuneBias = 50; // Oven not calibrated
+	}
+	tuneStep = (tuneBias < 50) ? tuneBias : 100 - tuneBias;
+	setDutyCycle(tuneBias - tuneStep);
+	tuneHigh = false;
+	tuneMax = ovenTemp;
+	tuneCycles = 0;
+	tuneAmplitude = 0;
+	tunePeriod = 0;
+	tuneSwitch = count;
+}
+
+// Relay, a cycle ends each time the heater switches from high to low
+static void TuneRelay(void)
+{
+	if (tuneHigh)
+	{
+		if (ovenTemp < tuneMin)
+		{
+			tuneMin = ovenTemp;
+		}
+		if (ovenTemp >= AUTOTUNE_SETPOINT + AUTOTUNE_HYST)
+		{
+			setDutyCycle(tuneBias - tuneStep);
+			tuneHigh = false;
+			tuneCycles++;
+			if (tuneCycles > AUTOTUNE_SETTLE)
+			{
+				tuneAmplitude += tuneMax - tuneMin;
+				tunePeriod += count - tuneSwitch;
+			}
+			tuneSwitch = count;
+			tuneMax = ovenTemp;
+		}
+	}
+	else
+	{
+		if (ovenTemp > tuneMax)
+		{
+			tuneMax = ovenTemp;
+		}
+		if (ovenTemp + AUTOTUNE_HYST <= AUTOTUNE_SETPOINT)
+		{
+			setDutyCycle(tuneBias + tuneStep);
+			tuneHigh = true;
+			tuneMin = ovenTemp;
+		}
+	}
+}
+
+static bool TuneDone(void)
+{
+	return (tuneCycles == AUTOTUNE_SETTLE + AUTOTUNE_CYCLES);
+}
+
+// Work out and save the gains, unless the relay timed out before it settled into an oscillation
+static void TuneFinish(void)
+{
+	__pidParams params;
+
+	HeaterOff(); //Turn off the SSR and then the EMR
+	lcd_gotoxy(0, 1);
+	if ((TuneDone()) && (tuneAmplitude))
+	{
+		params.Ku = PIDController_RelayTune(&pid, (int32_t)tuneStep << 16, ((int32_t)tuneAmplitude << 16) / (2 * AUTOTUNE_CYCLES),
+			((int32_t)tunePeriod << 16) / (AUTOTUNE_CYCLES * controlRate));
+		params.Pu = ((uint32_t)tunePeriod * 10) / (AUTOTUNE_CYCLES * controlRate);
+		params.Kp = pid.Kp;
+		params.Ki = pid.Ki;
+		params.Kd = pid.Kd;
+		params.tau = pid.tau;
+		params.tuned = 1;
+		eeprom_update_block((const void*)&params, (void*)&PidParams, sizeof(__pidParams));
+		fprintf_P(&USBSerialStream, PSTR("=ATUNE,%u,%u,%ld,%u,%ld,%ld,%ld,%ld\n"), tuneBias, tuneStep, Q16Milli(params.Ku), params.Pu,
+			Q16Milli(params.Kp), Q16Milli(params.Ki), Q16Milli(params.Kd), Q16Milli(params.tau));
+		lcd_puts_P("Tuned          ");
+	}
+	else
+	{
+		lcd_puts_P("Tune failed    ");
+	}
+}
+
+const char TuneTitle[] PROGMEM = "Autotune";
+const char TuneLabel4[] PROGMEM = "Relay          ";
+
+const STAGE AutotuneStages[] PROGMEM =
+{
+	STAGE_CLOSE_DOOR,
+	{2, 0, 0, 0, IdentLabel2, TuneStart, NULL, NULL, NULL},
+	{3, 0, 0, AUTOTUNE_SETPOINT >> 2, NULL, NULL, NULL, StageAtTemp, TuneRelayStart},
+	{4, STAGE_TICK, AUTOTUNE_TIMEOUT, 0, TuneLabel4, NULL, TuneRelay, TuneDone, NULL},
+	{5, STAGE_LAST, 0, 0, NULL, TuneFinish, NULL, NULL, NULL}
+};
+
+void AutotuneCommand()
+{
+	StageStart(AutotuneStages, TuneTitle);
+};
+
+//==============================================================================================================================
+// Take the temperature samples that completed before an event
+
+static void TakeSamples(uint32_t before)
+{
+	SPI_SAMPLE sample;
+
+	while (spi_get_sample(&sample, before))
+	{
+		ovenFaultsAccum |= sample.Faults;
+		if (readings < 10)
+		{
+			ovenTempAccum += sample.Value;
+			ovenJunctionAccum += sample.Junction;
+			readings++;
+		}
+		if (historyReadings < 10)
+		{
+			historyAccum += sample.Value;
+			historyReadings++;
+		}
+	}
+}
+
+//==============================================================================================================================
+// One pass of the control loop. Every event the timer has queued since the last pass is handled in order, each with the
+// samples that came before it, so a late main loop catches up instead of losing ticks. Called from the main loop after
+// the buttons have been read.
+
+void ControlTask(void)
+{
+	CONTROL_EVENT event;
+	bool ticked = false;
+	uint32_t before;
+	uint8_t mains;
+	uint8_t overruns;
+
+	while (GetEvent(&event))
+	{
+		TakeSamples(event.Time);
+
+		if (event.Type == CONTROL_WINDOW)
+		{
+			UpdateHistory();
+			continue;
+		}
+
+		if (isRunning)
+		{
+			tick = 1;
+			(*ProcessHandler)();
+			tick = 0;
+		}
+		ticked = true;
+
+		mains = getMainsFrequency();
+		if (mains != zcReported)
+		{
+			fprintf(&USBSerialStream, "=MAINS,%u\n", mains);
+			zcReported = mains;
+		}
+		overruns = eventOverruns + spiOverruns;
+		if (overruns != overrunsReported)
+		{
+			SendLoopStats();
+			overrunsReported = overruns;
+		}
+		UpdateTemp();
+	}
+
+	// Samples since the last event start the next one's averages, so the SPI queue never has to hold them
+	cli();
+	before = (eventHead == eventTail) ? timerBase + TIMER1_PERIOD : eventQueue[eventTail & EVENT_QUEUE_MASK].Time;
+	sei();
+	TakeSamples(before);
+
+	// The handlers also watch the buttons between ticks
+	if ((isRunning) && (!ticked))
+	{
+		(*ProcessHandler)();
+	}
+}
+
+//==============================================================================================================================
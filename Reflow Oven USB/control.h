@@ -0,0 +1,224 @@
+//==============================================================================================================================
+// U S B   R E F L O W   O V E N   C O N T R O L   C O R E
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Control.h"
+// Title 			: Oven control core (temperature acquisition, profile and calibration stages)
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2 (or host, see hal.h)
+// Author			: Simon Ratcliffe
+
+
+#ifndef CONTROL_H_
+#define CONTROL_H_
+
+#include "pid.h"
+
+//==============================================================================================================================
+// Defines
+
+#define OVEN_RELAY_SSR		PB4
+#define OVEN_RELAY_EMR		PB5
+
+#define EMR_ON						PORTB &= ~_BV(OVEN_RELAY_EMR)
+#define EMR_OFF						PORTB |= _BV(OVEN_RELAY_EMR)
+
+#define SSR_ON						PORTB |= _BV(OVEN_RELAY_SSR)
+#define SSR_OFF						PORTB &= ~_BV(OVEN_RELAY_SSR)
+
+#define TIMER1_PERIOD			1250 // OCR1A, 10ms at F_CPU/64
+
+// Optional mains zero-cross detector, a pulse per zero crossing on PB6 (PCINT6). Without one the SSR runs off the timer.
+#define ZERO_CROSS_PIN		PB6
+
+// MENU button, also watched by pin change (PCINT9) so it can abort a run straight from the interrupt
+#define ABORT_PIN					PC5
+
+// STAGE.Flags
+#define STAGE_TICK				0x01	// Run and Guard only on control ticks, not for buttons in between
+#define STAGE_LAST				0x02	// Leaving it ends the run
+
+// Over-temperature trip, 0.25c units, and the hottest a profile may ask for below it, c, leaving room for the overshoot
+// at the end of reflow
+#define SAFETY_MAX_TEMP		1080	// 270c
+#define PROFILE_MAX_TEMP	((SAFETY_MAX_TEMP >> 2) - 15)
+
+// Safety supervisor trip reasons, reported as =TRIP,<reason>,<us>
+#define SAFETY_ABORT			1
+#define SAFETY_OVERTEMP		2
+#define SAFETY_SENSOR			3
+
+// CONTROL_EVENT.Type
+#define CONTROL_TICK			1		// Run the stage handler and send a temperature packet
+#define CONTROL_WINDOW		2		// Half second history boundary
+
+//==============================================================================================================================
+// Typedefs
+
+typedef struct
+{
+	char name[PROFILE_NAME_LEN];
+	unsigned char calibrated;
+	unsigned char preheat_temp;
+	unsigned char soak_dutycycle;
+	unsigned char soak_rate;
+	unsigned char soak_time;
+	unsigned char soak_temp;
+	unsigned char reflow_time;
+	unsigned char reflow_temp;
+	unsigned char preheat_cutoff;
+	unsigned char reflow_cutoff;
+} __profile;
+
+// Oven thermal model from the one run calibration
+typedef struct
+{
+	unsigned char identified;
+	uint8_t deadTime; // Half second ticks from full power until the oven has risen 1c
+	uint16_t fullRate; // Rise at full power with no loss, ovenDelta32 units (1/512 c/s)
+} __ovenModel;
+
+// PID gains the profile engine runs with, Q16.16 (see pid.h). Written by the autotune, Ku and Pu are kept for reference.
+typedef struct
+{
+	unsigned char tuned;
+	int32_t Kp;
+	int32_t Ki;
+	int32_t Kd;
+	int32_t tau;
+	int32_t Ku; // Ultimate gain
+	uint16_t Pu; // Ultimate period in tenths of a second
+} __pidParams;
+
+// One stage of a run, see StageHandler. Every action is optional.
+typedef struct
+{
+	uint8_t Stage;						// Reported as ovenStage
+	uint8_t Flags;						// STAGE_ flags
+	uint16_t Timeout;					// Seconds of control ticks before the stage is left anyway, 0 for none
+	uint8_t Arg;							// For the actions, a duty or a temperature in c
+	PGM_P Label;							// Shown on the second line when the stage starts
+	void (*Enter)(void);			// On the first pass
+	void (*Run)(void);				// Every pass
+	bool (*Guard)(void);			// After Run, the stage is left when it's true. With neither this nor a Timeout the stage
+														// is left after one pass.
+	void (*Exit)(void);				// On leaving, in the same pass
+} STAGE;
+
+// Timer1 interrupt to main loop event, see ControlTask
+typedef struct
+{
+	uint8_t Type;				// CONTROL_TICK or CONTROL_WINDOW
+	uint32_t Time;			// Timer1 counts (8us) at the compare match, same clock as SPI_SAMPLE.Time
+} CONTROL_EVENT;
+
+//==============================================================================================================================
+// EEPROM Variables
+
+extern uint8_t EEMEM OvenCalibrated;
+extern uint8_t EEMEM ProfileCount;
+extern __profile EEMEM Profiles[MAX_PROFILES];
+extern uint8_t EEMEM TempCounts[20];
+extern uint16_t EEMEM FinalTemps[20];
+extern __ovenModel EEMEM OvenModel;
+extern uint8_t EEMEM ControlRate;
+extern __pidParams EEMEM PidParams;
+
+//==============================================================================================================================
+// Global Variables
+
+// Owned by the control core
+extern bool isRunning;
+extern bool showTemp;
+extern uint16_t ovenTemp;
+extern int16_t ovenJunction;
+extern uint8_t ovenFaults;
+extern int16_t ovenDelta4;
+extern int16_t ovenDelta16;
+extern int16_t ovenDelta32;
+extern int16_t ovenRateOfChange;
+extern uint8_t ovenStage;
+extern int16_t ovenError;
+extern uint16_t count;
+extern __profile profile;
+extern uint8_t tick;
+extern uint8_t controlRate;
+extern uint16_t controlPeriod;
+extern volatile uint8_t duty_cycle;
+extern PIDController pid;
+extern volatile uint8_t zcLock;
+extern volatile uint16_t zcPeriod;
+extern volatile uint8_t eventOverruns;
+extern volatile uint32_t timerBase;
+extern uint8_t eventDepthMax;
+
+// Owned by the application (or the simulator)
+extern FILE USBSerialStream;
+extern bool lcdPresent;
+extern uint8_t buttons;
+extern uint8_t newButton;
+
+//==============================================================================================================================
+// Function Prototypes
+
+	uint32_t GetTimerCounts(void);
+	uint32_t GetUptime(void);
+	bool setControlRate(uint8_t);
+	void UpdateHistory(void);
+	bool ControlPending(void);
+	void FlushEvents(void);
+	void SendLoopStats(void);
+	void UpdateTemp(void);
+	void setDutyCycle (uint8_t);
+	void setDutyCycleFine (uint16_t);
+	void HeaterOn(void);
+	void HeaterOff(void);
+	void SafetyAbort(void);
+	bool SafetyService(void);
+	uint8_t getMainsFrequency(void);
+	void loadDutyMap(void);
+	int32_t getDutyCycle(uint16_t);
+	void printProfile (void);
+	void RunProfileCommand(void);
+	void CalibrateOvenCommand(void);
+	void IdentifyOvenCommand(void);
+	void PIDTestCommand(void);
+	void Calibrate60cCommand(void);
+	void Calibrate120cCommand(void);
+	void AutotuneCommand(void);
+	void HostStart(void (*)(void));
+	void ControlTask(void);
+
+//==============================================================================================================================
+// Inline Functions
+
+// A Timer1 compare match is pending behind the caller and counts, read from TCNT1, has already wrapped past it.
+// Interrupts must be off.
+static inline bool TimerWrapped(uint16_t counts)
+{
+	return ((TIFR1 & _BV(OCF1A)) && (counts < (TIMER1_PERIOD / 2)));
+}
+
+// Timer1 counts now, allowing for a compare match that is pending behind the caller. Interrupts must be off.
+static inline uint32_t TimerNow(void)
+{
+	uint16_t counts = TCNT1;
+	uint32_t now = timerBase + counts;
+
+	if (TimerWrapped(counts))
+	{
+		now += TIMER1_PERIOD;
+	}
+	return now;
+}
+
+// Soak setpoint, 0.25c, n of ticks into a soak from the preheat temp to the soak temp (both c). One 32 bit division that
+// truncates toward the preheat temp, as the float ramp it replaced did, and agrees with it to within a count
+// (Simulator/pidcheck.c).
+static inline uint16_t SoakSetpoint(uint8_t preheat, uint8_t soak, uint16_t n, uint16_t ticks)
+{
+	return ((uint16_t)preheat << 2) + (uint16_t)(((((int32_t)soak - preheat) << 2) * n) / ticks);
+}
+
+#endif /* CONTROL_H_ */
@@ -0,0 +1,150 @@
+//==============================================================================================================================
+// H A R D W A R E   A B S T R A C T I O N
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Hal.h"
+// Title 			: Hardware abstraction for the oven control core
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+//
+// The control core (control.c, pid.c) includes this instead of the avr-libc headers. On the target it simply pulls in
+// the real headers. When HOST_BUILD is defined it maps the handful of registers, EEPROM, PROGMEM and delay calls that
+// the core uses onto plain C so the same sources can be driven by the simulator in the Simulator directory.
+
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef HOST_BUILD
+
+//==============================================================================================================================
+// Target
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+#include <util/crc16.h>
+
+#else
+
+//==============================================================================================================================
+// Host
+
+// I/O ports touched by the control core, provided by the simulator
+extern volatile uint8_t PORTB;
+extern volatile uint8_t PORTD;
+extern volatile uint8_t PINB;
+extern volatile uint8_t PINC;
+extern volatile uint16_t TCNT1;
+extern volatile uint8_t TIFR1;
+
+#define PB4								4
+#define PB5								5
+#define PB6								6
+#define PC5								5
+#define OCF1A							1
+#define PD7								7
+
+#define _BV(bit)					(1 << (bit))
+
+// Interrupts are serviced by the simulator calling the vector directly
+#define ISR(vector, ...)	void vector(void)
+#define sei()
+#define cli()
+
+void TIMER1_COMPA_vect(void);
+void PCINT0_vect(void);
+void PCINT1_vect(void);
+
+// Busy waits advance simulated time instead of stalling
+void hal_delay_ms(uint16_t ms);
+#define _delay_ms(ms)			hal_delay_ms(ms)
+
+// PROGMEM lives in ordinary memory
+#define PROGMEM
+#define PGM_P							const char*
+#define PSTR(s)						(s)
+#define pgm_read_byte(p)	(*(const uint8_t*)(p))
+#define pgm_read_word(p)	(*(const uint16_t*)(p))
+#define sprintf_P					sprintf
+#define fprintf_P					fprintf
+#define strcpy_P					strcpy
+#define memcpy_P					memcpy
+
+// avr-libc util/crc16.h, CRC-16/XMODEM (polynomial 0x1021)
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data)
+{
+	uint8_t i;
+
+	crc ^= (uint16_t)data << 8;
+	for (i = 0; i < 8; i++)
+	{
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+	}
+	return crc;
+}
+
+// EEPROM lives in ordinary memory
+#define EEMEM
+
+static inline uint8_t eeprom_read_byte(const uint8_t *p) { return *p; }
+static inline uint16_t eeprom_read_word(const uint16_t *p) { return *p; }
+static inline void eeprom_read_block(void *dst, const void *src, size_t n) { memcpy(dst, src, n); }
+static inline void eeprom_write_byte(uint8_t *p, uint8_t value) { *p = value; }
+static inline void eeprom_write_word(uint16_t *p, uint16_t value) { *p = value; }
+static inline void eeprom_write_block(const void *src, void *dst, size_t n) { memcpy(dst, src, n); }
+static inline void eeprom_update_byte(uint8_t *p, uint8_t value) { *p = value; }
+static inline void eeprom_update_word(uint16_t *p, uint16_t value) { *p = value; }
+static inline void eeprom_update_block(const void *src, void *dst, size_t n) { memcpy(dst, src, n); }
+
+// The USB CDC stream is whatever FILE the simulator points this at
+extern FILE *hal_usb_stream;
+#define USBSerialStream		(*hal_usb_stream)
+
+// The parts of LUFA used by usbtx.c and usbrx.c, the endpoint calls are provided by the simulator
+typedef struct
+{
+	struct
+	{
+		struct
+		{
+			uint8_t Address;
+		} DataINEndpoint;
+	} Config;
+	struct
+	{
+		struct
+		{
+			uint32_t BaudRateBPS;
+		} LineEncoding;
+	} State;
+} USB_ClassInfo_CDC_Device_t;
+
+#define DEVICE_STATE_Configured	4
+extern volatile uint8_t USB_DeviceState;
+
+void Endpoint_SelectEndpoint(uint8_t address);
+bool Endpoint_IsINReady(void);
+bool Endpoint_IsReadWriteAllowed(void);
+void Endpoint_Write_8(uint8_t data);
+void Endpoint_ClearIN(void);
+int16_t CDC_Device_ReceiveByte(USB_ClassInfo_CDC_Device_t *cdc);
+
+// avr-libc stdio streams, the simulator decides where the put function's output goes
+#define _FDEV_SETUP_WRITE	0x0002
+void hal_fdev_setup_stream(FILE *stream, int (*put)(char, FILE*), int (*get)(FILE*), uint8_t flags);
+#define fdev_setup_stream(stream, put, get, flags)	hal_fdev_setup_stream(stream, put, get, flags)
+
+#endif
+
+#endif /* HAL_H_ */
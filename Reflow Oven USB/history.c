@@ -0,0 +1,74 @@
+//==============================================================================================================================
+// S A M P L E   H I S T O R Y
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "History.c"
+// Title 			: Ring buffer sample history with running window sums
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+//
+// Adding a sample costs two reads per window whatever the history length, instead of shifting the whole history down
+// and summing every window again.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "hal.h"
+
+#include "history.h"
+
+//==============================================================================================================================
+// Ring index of the sample that is age samples older than the newest
+
+static inline uint8_t HistoryIndex(const HISTORY *history, uint8_t age)
+{
+	return (history->Head >= age) ? history->Head - age : history->Head + history->Length - age;
+}
+
+//==============================================================================================================================
+// Add a sample, the first one after priming fills the whole history
+
+void HistoryPush(HISTORY *history, uint16_t value)
+{
+	uint8_t i;
+
+	if (!history->Primed)
+	{
+		for (i = 0; i < history->Length; i++)
+		{
+			history->Samples[i] = value;
+		}
+		for (i = 0; i <= history->LagCount; i++)
+		{
+			history->Sums[i] = value * HISTORY_WINDOW;
+		}
+		history->Head = 0;
+		history->Primed = true;
+		return;
+	}
+
+	// Everything is read through the old head before the oldest sample is overwritten
+	history->Sums[0] += value - history->Samples[HistoryIndex(history, HISTORY_WINDOW - 1)];
+	for (i = 0; i < history->LagCount; i++)
+	{
+		uint8_t lag = history->Lags[i];
+
+		history->Sums[i + 1] += history->Samples[HistoryIndex(history, lag - 1)] - history->Samples[HistoryIndex(history, lag + HISTORY_WINDOW - 1)];
+	}
+
+	history->Head = (history->Head + 1 == history->Length) ? 0 : history->Head + 1;
+	history->Samples[history->Head] = value;
+}
+
+//==============================================================================================================================
+// Newest window less the lagged window Lags[n]
+
+int16_t HistoryDelta(const HISTORY *history, uint8_t n)
+{
+	return (int16_t)(history->Sums[0] - history->Sums[n + 1]);
+}
+
+//==============================================================================================================================
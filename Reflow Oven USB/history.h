@@ -0,0 +1,43 @@
+//==============================================================================================================================
+// S A M P L E   H I S T O R Y
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "History.h"
+// Title 			: Ring buffer sample history with running window sums
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+//==============================================================================================================================
+// Defines
+
+#define HISTORY_WINDOW		4		// Samples summed at each end of a delta
+
+//==============================================================================================================================
+// Typedefs
+
+// The sums are kept modulo 2^16, exactly like the int16_t cast of the plain sum, so fault codes in the samples do not
+// upset the running totals once they have passed through.
+typedef struct
+{
+	uint16_t *Samples;				// Ring storage, Length entries, newest at Head
+	const uint8_t *Lags;			// Age in samples of the newest sample of each lagged window
+	uint16_t *Sums;						// Sums[0] is the newest window, Sums[n+1] the window at Lags[n]
+	uint8_t Length;						// Must be at least the largest lag + HISTORY_WINDOW
+	uint8_t LagCount;
+	uint8_t Head;
+	bool Primed;							// Cleared to refill the whole history from the next sample
+} HISTORY;
+
+//==============================================================================================================================
+// Function Prototypes
+
+	void HistoryPush(HISTORY*, uint16_t);
+	int16_t HistoryDelta(const HISTORY*, uint8_t);
+
+#endif /* HISTORY_H_ */
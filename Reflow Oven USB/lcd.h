@@ -38,7 +38,11 @@
 #endif
 
 #include <inttypes.h>
+#ifdef HOST_BUILD
+#include "hal.h"
+#else
 #include <avr/pgmspace.h>
+#endif
 
 /** 
  *  @name  Definitions for MCU Clock Frequency
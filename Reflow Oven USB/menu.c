@@ -15,6 +15,7 @@
 
 #include <avr/io.h>
 #include <avr/eeprom.h>
+#include <stdbool.h>
 
 #include "lcd.h"
 #include "menu.h"
@@ -1,64 +1,163 @@
 #include <stdio.h>
 
-#include "PID.h"
+#include "pid.h"
+
+/* No term is allowed past 2^29 (8192 in output units), so the sum of all three still fits */
+#define PID_TERM_MAX	0x20000000L
+
+/* a * f / 65536 for a fraction f, built from 16 x 16 multiplies */
+static int32_t pid_mulfrac(int32_t a, uint16_t f) {
+	int16_t ahi = a >> 16;
+	uint16_t alo = (uint16_t)a;
+
+	return (int32_t)ahi * f + (int32_t)(((uint32_t)alo * f) >> 16);
+}
+
+/* a * q / 65536 for a Q16.16 q, the result must fit */
+static int32_t pid_mul(int32_t a, int32_t q) {
+	return a * (q >> 16) + pid_mulfrac(a, (uint16_t)q);
+}
+
+/* n / d as Q16.16, only used when the controller is set up */
+static int32_t pid_div(int32_t n, int32_t d) {
+	uint32_t un = (n < 0) ? -n : n;
+	uint32_t ud = (d < 0) ? -d : d;
+	uint32_t q = un / ud;
+	uint32_t r = un % ud;
+	uint8_t i;
+
+	for (i = 0; i < 16; i++)
+	{
+		q <<= 1;
+		r <<= 1;
+		if (r >= ud)
+		{
+			r -= ud;
+			q |= 1;
+		}
+	}
+	return ((n < 0) != (d < 0)) ? -(int32_t)q : (int32_t)q;
+}
+
+/* pi as 355 / 113 */
+#define PID_PI_NUM		355
+#define PID_PI_DEN		113
+
+/* Largest input that keeps gain * input inside PID_TERM_MAX */
+static int16_t pid_limit(int32_t gain) {
+	if (gain < 0)
+	{
+		gain = -gain;
+	}
+	if (gain <= (PID_TERM_MAX / INT16_MAX))
+	{
+		return INT16_MAX;
+	}
+	return PID_TERM_MAX / gain;
+}
+
+static int32_t pid_clamp32(int32_t x) {
+	if (x > PID_TERM_MAX)
+	{
+		return PID_TERM_MAX;
+	}
+	else if (x < -PID_TERM_MAX)
+	{
+		return -PID_TERM_MAX;
+	}
+	return x;
+}
+
+static int16_t pid_clamp(int32_t x, int16_t lim) {
+	if (x > lim)
+	{
+		return lim;
+	}
+	else if (x < -lim)
+	{
+		return -lim;
+	}
+	return x;
+}
 
 void PIDController_Init(PIDController *pid) {
+	// Work out the per sample coefficients
+	pid->kiT = pid_mul(pid->Ki, pid->T) / 2;
+	pid->kdD = pid_div(2 * pid->Kd, 2 * pid->tau + pid->T);
+	pid->alpha = pid_div(2 * pid->tau - pid->T, 2 * pid->tau + pid->T);
+
+	pid->limP = pid_limit(pid->Kp);
+	pid->limI = pid_limit(pid->kiT);
+	pid->limD = pid_limit(pid->kdD);
+
 	// Clear controller variables
-	pid->integrator = 0.0f;
-	pid->prevError  = 0.0f;
+	pid->integrator = 0;
+	pid->prevError  = 0;
 
-	pid->differentiator  = 0.0f;
-	pid->prevMeasurement = 0.0f;
+	pid->differentiator  = 0;
 
+	pid->ff = 0;
 	pid->out = 0;
+	pid->outFine = 0;
 }
 
 uint16_t PIDController_Update(PIDController *pid, uint16_t setpoint, uint16_t measurement) {
 	// Error signal
-  float error = ((float)setpoint*4.0) - (float)measurement;
+  int16_t error = (int16_t)(setpoint - measurement);
 
 
 	// Proportional
-  pid->proportional = pid->Kp * error;
+  pid->proportional = pid->Kp * pid_clamp(error, pid->limP);
 
 	// Integral
-  pid->integrator = pid->integrator + 0.5f * pid->Ki * pid->T * (error + pid->prevError);
+  pid->integrator = pid->integrator + pid->kiT * pid_clamp((int32_t)error + pid->prevError, pid->limI);
 
 	// Anti-wind-up via integrator clamping
   if (pid->integrator > pid->limMaxInt)
 	{
     pid->integrator = pid->limMaxInt;
-  } 
-	else if (pid->integrator < pid->limMinInt) 
+  }
+	else if (pid->integrator < pid->limMinInt)
 	{
     pid->integrator = pid->limMinInt;
 	}
 
 	// Derivative (band-limited differentiator)
-  pid->differentiator = -(2.0f * pid->Kd * (measurement - pid->prevMeasurement)	// Note: derivative on measurement, therefore minus sign in front of equation!
-                        + (2.0f * pid->tau - pid->T) * pid->differentiator)
-                        / (2.0f * pid->tau + pid->T);
+  pid->differentiator = pid->kdD * pid_clamp((int32_t)error - pid->prevError, pid->limD)	// Note: derivative on error, the setpoint only ever moves in small steps
+                        + pid_mul(pid->differentiator, pid->alpha);
+  pid->differentiator = pid_clamp32(pid->differentiator);
 
 	// Compute output and apply limits
-	float result = pid->proportional + pid->integrator + pid->differentiator;
+	int32_t result = pid->proportional + pid->integrator + pid->differentiator + pid->ff;
 
-  if (result > pid->limMax) 
-	{
-    pid->out = (uint16_t)pid->limMax;
-  } 
-	else if (result < pid->limMin) 
+  if (result > pid->limMax)
 	{
-    pid->out = (uint16_t)pid->limMin;
+    result = pid->limMax;
   }
-	else
+	else if (result < pid->limMin)
 	{
-		pid->out = (uint16_t)result;
-	}
+    result = pid->limMin;
+  }
+	pid->out = (uint16_t)(result >> 16);
+	pid->outFine = (uint16_t)(result >> 8);
 
-	// Store error and measurement for later use
+	// Store error for later use
   pid->prevError       = error;
-  pid->prevMeasurement = measurement;
 
 	// Return controller output
   return pid->out;
-}
\ No newline at end of file
+}
+
+/* Gains from a relay feedback test (Astrom-Hagglund). d is the relay step either side of the bias and a the half peak to
+ * peak oscillation, both Q16.16 in output and input units, Tu is the oscillation period in seconds. Uses the
+ * Ziegler-Nichols "no overshoot" rule, the profiles would rather lag than overshoot. Returns the ultimate gain. */
+int32_t PIDController_RelayTune(PIDController *pid, int32_t d, int32_t a, int32_t Tu) {
+	int32_t Ku = pid_div(4 * PID_PI_DEN * (d >> 8), PID_PI_NUM * (a >> 8));
+
+	pid->Kp = Ku / 5;                       /* 0.2 Ku */
+	pid->Ki = pid_div(2 * pid->Kp, Tu);     /* Ti = Tu / 2 */
+	pid->Kd = pid_mul(pid->Kp, Tu) / 3;     /* Td = Tu / 3 */
+	pid->tau = Tu / 24;                     /* Filter at Td / 8 */
+
+	return Ku;
+}
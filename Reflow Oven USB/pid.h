@@ -1,40 +1,58 @@
 #ifndef PID_CONTROLLER_H
 #define PID_CONTROLLER_H
 
+#include <stdint.h>
+
+/* Gains, limits and times are Q16.16 fixed point, write them with PID_Q16 so the conversion is done by the compiler */
+#define PID_Q16(x)	((int32_t)((x) * 65536.0 + (((x) < 0) ? -0.5 : 0.5)))
+
 typedef struct {
 
 	/* Controller gains */
-	float Kp;
-	float Ki;
-	float Kd;
+	int32_t Kp;
+	int32_t Ki;
+	int32_t Kd;
 
 	/* Derivative low-pass filter time constant */
-	float tau;
+	int32_t tau;
 
 	/* Output limits */
-	float limMin;
-	float limMax;
-	
+	int32_t limMin;
+	int32_t limMax;
+
 	/* Integrator limits */
-	float limMinInt;
-	float limMaxInt;
+	int32_t limMinInt;
+	int32_t limMaxInt;
 
 	/* Sample time (in seconds) */
-	float T;
+	int32_t T;
+
+	/* Feedforward, added to the output before the limits */
+	int32_t ff;
+
+	/* Worked out from the above by PIDController_Init */
+	int32_t kiT;				/* Ki * T / 2 */
+	int32_t kdD;				/* 2 * Kd / (2 * tau + T) */
+	int32_t alpha;			/* (2 * tau - T) / (2 * tau + T) */
+	int16_t limP;				/* Input limits that keep each term inside int32 */
+	int16_t limI;
+	int16_t limD;
 
 	/* Controller "memory" */
-	float proportional;
-	float integrator;
-	float prevError;			/* Required for integrator */
-	float differentiator;
-	float prevMeasurement;		/* Required for differentiator */
+	int32_t proportional;
+	int32_t integrator;
+	int16_t prevError;			/* Required for integrator and differentiator, 0.25c steps */
+	int32_t differentiator;
 
-	/* Controller output */
+	/* Controller output, truncated to whole counts, which can leave it one count from the float controller it replaced
+	 * (Simulator/pidcheck.c) */
 	uint16_t out;
+	uint16_t outFine;			/* Same in 1/256 steps */
 
 } PIDController;
 
 void  PIDController_Init(PIDController *pid);
 uint16_t PIDController_Update(PIDController *pid, uint16_t setpoint, uint16_t measurement);
+int32_t PIDController_RelayTune(PIDController *pid, int32_t d, int32_t a, int32_t Tu);
 
-#endif
\ No newline at end of file
+#endif
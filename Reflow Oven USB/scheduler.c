@@ -0,0 +1,170 @@
+//==============================================================================================================================
+// T A S K   S C H E D U L E R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Scheduler.c"
+// Title 			: Run to completion main loop scheduler with idle sleep
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+//
+// Each pass runs every task that is due, in table order, and then sleeps in idle mode until an interrupt (the 10ms
+// timer, the SPI, the zero-cross or USB) gives it something to do.
+
+
+//==============================================================================================================================
+// Includes
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "ReflowOven.h"
+#include "control.h"
+#include "scheduler.h"
+
+//==============================================================================================================================
+// External variables
+
+extern volatile uint32_t uptime;
+
+//==============================================================================================================================
+// Private variables
+
+static TASK *schedTasks;
+static uint8_t schedCount;
+
+//==============================================================================================================================
+// Functions
+
+void SchedulerInit(TASK *tasks, uint8_t count)
+{
+	uint8_t i;
+
+	schedTasks = tasks;
+	schedCount = count;
+
+	cli();
+	for (i = 0; i < count; i++)
+	{
+		tasks[i].Due = uptime;
+	}
+	sei();
+
+	set_sleep_mode(SLEEP_MODE_IDLE);
+}
+
+//==============================================================================================================================
+// Whether a task has to run this pass, now is the uptime at the last timer slot. An event driven task's due time follows
+// the clock until it has work, so lateness is measured from the pass that first saw it.
+
+static bool SchedulerDue(TASK *task, uint32_t now)
+{
+	if (task->Ready)
+	{
+		if (task->Ready())
+		{
+			return true;
+		}
+		task->Due = now;
+		return false;
+	}
+	if (task->Period)
+	{
+		return ((int32_t)(now - task->Due) >= 0);
+	}
+	return false;
+}
+
+//==============================================================================================================================
+// One pass of the main loop
+
+void SchedulerPass(void)
+{
+	TASK *task;
+	uint32_t now;
+	uint32_t start;
+	uint32_t time;
+	bool busy = false;
+
+	cli();
+	now = uptime;
+	sei();
+
+	for (task = schedTasks; task < schedTasks + schedCount; task++)
+	{
+		if ((task->Ready) || (task->Period))
+		{
+			if (!SchedulerDue(task, now))
+			{
+				continue;
+			}
+		}
+		else
+		{
+			task->Due = now; // Runs after every wake up
+		}
+
+		start = GetTimerCounts();
+		task->Run();
+		time = GetTimerCounts() - start;
+
+		if (time > task->MaxTime)
+		{
+			task->MaxTime = (time > UINT16_MAX) ? UINT16_MAX : time;
+		}
+		if (((int32_t)(GetUptime() - task->Due) > task->Deadline) && (task->Misses < UINT16_MAX))
+		{
+			task->Misses++;
+		}
+		if (task->Period)
+		{
+			task->Due += task->Period;
+			if ((int32_t)(now - task->Due) >= 0)
+			{
+				task->Due = now + task->Period; // More than a period behind, skip rather than run it back to back
+			}
+		}
+	}
+
+	// Interrupts stay off from the last look until the sleep instruction, so anything that arrives in between wakes it
+	cli();
+	now = uptime;
+	for (task = schedTasks; task < schedTasks + schedCount; task++)
+	{
+		if (SchedulerDue(task, now))
+		{
+			busy = true;
+			break;
+		}
+	}
+	if (busy)
+	{
+		sei();
+		return;
+	}
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+}
+
+//==============================================================================================================================
+// Send the longest run (us) and deadline misses of each task
+
+void SchedulerReport(FILE *stream)
+{
+	TASK *task;
+
+	fputs_P(PSTR("=TASKS"), stream);
+	for (task = schedTasks; task < schedTasks + schedCount; task++)
+	{
+		fprintf_P(stream, PSTR(",%S,%lu,%u"), task->Name, (unsigned long)task->MaxTime * 8, task->Misses);
+	}
+	fputs_P(PSTR("\n"), stream);
+}
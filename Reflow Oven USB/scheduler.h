@@ -0,0 +1,40 @@
+//==============================================================================================================================
+// T A S K   S C H E D U L E R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Scheduler.h"
+// Title 			: Run to completion main loop scheduler with idle sleep
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+//==============================================================================================================================
+// Typedefs
+
+// A task is periodic (Period set), event driven (Ready set) or, with neither, run once after every wake up. Only the first
+// two keep the CPU awake.
+typedef struct
+{
+	PGM_P Name;
+	void (*Run)(void);
+	bool (*Ready)(void);			// True while the task has work, called with interrupts off
+	uint16_t Period;					// ms, a multiple of the 10ms timer slot
+	uint16_t Deadline;				// ms from becoming due until the run has to have finished
+	uint32_t Due;							// uptime (ms) the task became due
+	uint16_t MaxTime;					// Longest run, Timer1 counts (8us)
+	uint16_t Misses;					// Runs that finished past the deadline
+} TASK;
+
+//==============================================================================================================================
+// Function Prototypes
+
+	void SchedulerInit(TASK*, uint8_t);
+	void SchedulerPass(void);
+	void SchedulerReport(FILE*);
+
+#endif /* SCHEDULER_H_ */
@@ -13,9 +13,16 @@
 // Includes
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <stdbool.h>
 #include <stdio.h>
 
+#include "ReflowOven.h"
+#include "control.h"
 #include "spi.h"
+#include "typek.h"
 
 //==============================================================================================================================
 // Defines
@@ -38,6 +45,33 @@
 #define SPI_MOSI				PB2
 #define SPI_MISO				PB3
 
+// Bytes in one converter frame
+#ifdef MAX6675
+#define SPI_FRAME_LEN		2
+#endif
+#ifdef MAX31855
+#define SPI_FRAME_LEN		4
+#endif
+
+// Completed samples waiting for the main loop, must be a power of two
+#define SPI_QUEUE_LEN		8
+#define SPI_QUEUE_MASK	(SPI_QUEUE_LEN - 1)
+
+//==============================================================================================================================
+// Private variables
+
+static volatile uint8_t spiFrame[SPI_FRAME_LEN];
+static volatile uint8_t spiFrameIdx;
+static volatile bool spiBusy = false;
+static uint32_t spiStart;								// Timer1 counts when the frame was started
+
+// Single producer (SPI_STC_vect) single consumer (main loop) queue. Head is only written by the interrupt and tail only
+// by the main loop, both are single bytes so no locking is needed.
+static SPI_SAMPLE spiQueue[SPI_QUEUE_LEN];
+static volatile uint8_t spiQueueHead = 0;
+static volatile uint8_t spiQueueTail = 0;
+volatile uint8_t spiOverruns = 0;
+
 //==============================================================================================================================
 // Functions
 
@@ -68,67 +102,143 @@ void spi_init (void)
 //==============================================================================================================================
 
 #ifdef MAX6675
-uint16_t spi_read (void)
+static void spi_decode (volatile uint8_t *val, SPI_SAMPLE *sample)
 {
-	uint16_t val;
+	uint16_t frame = (val[0] << 8) | val[1];
 
-	SPI_PORT &= ~_BV(SPI_SS);
+	sample->Junction = 0; // No cold junction reading on this part
+	sample->Faults = 0;
+	if (frame & _BV(2))
+	{
+		sample->Faults = SPI_FAULT_OC | SPI_FAULT_ANY;
+		sample->Value = 65535;
+	}
+	else
+	{
+		sample->Value = frame >> 3;
+	}
+}
+#endif
 
-	SPDR = 0;
-	while(!(SPSR & (1<<SPIF)));
-	val = SPDR << 8;
+//==============================================================================================================================
+// D31-D18 thermocouple (signed, 0.25c), D16 fault, D15-D4 cold junction (signed, 0.0625c), D2-D0 SCV, SCG, OC
 
-	SPDR = 0;
-	while(!(SPSR & (1<<SPIF)));
-	val |= SPDR;
+#ifdef MAX31855
+static void spi_decode (volatile uint8_t *val, SPI_SAMPLE *sample)
+{
+	int16_t thermocouple = (int16_t)((val[0] << 8) | val[1]) >> 2;
 
-	SPI_PORT |= _BV(SPI_SS);
+	sample->Junction = (int16_t)((val[2] << 8) | val[3]) >> 4;
+	sample->Faults = val[3] & (SPI_FAULT_OC | SPI_FAULT_SCG | SPI_FAULT_SCV);
+	if (val[1] & _BV(0))
+	{
+		sample->Faults |= SPI_FAULT_ANY;
+	}
 
-	if (val & _BV(2))
+	if (sample->Faults & SPI_FAULT_OC)
+	{
+		sample->Value = 65535;
+	}
+	else if (sample->Faults & SPI_FAULT_SCG)
 	{
-	  return 65535;
+		sample->Value = 65534;
+	}
+	else if (sample->Faults & SPI_FAULT_SCV)
+	{
+		sample->Value = 65533;
 	}
 	else
 	{
-		return (val >> 3);
+		sample->Value = (thermocouple < 0) ? 0 : thermocouple; // The oven never runs below freezing
 	}
 }
 #endif
 
 //==============================================================================================================================
+// Start clocking a frame in the background, called from the Timer1 interrupt so samples are evenly spaced
 
-#ifdef MAX31855
-uint16_t spi_read (void)
+void spi_start (void)
 {
-	uint8_t val[4];
-	uint8_t i;
-	
+	if (spiBusy)
+	{
+		return;
+	}
+	spiBusy = true;
+	spiStart = TimerNow();
+	spiFrameIdx = 0;
 	SPI_PORT &= ~_BV(SPI_SS);
+	SPCR |= _BV(SPIE);
+	SPDR = 0;
+}
+
+//==============================================================================================================================
+// Take the oldest completed sample if it finished before the given time (Timer1 counts), returns 0 if there is none
+
+uint8_t spi_get_sample (SPI_SAMPLE *sample, uint32_t before)
+{
+	uint8_t tail = spiQueueTail;
 
-	for (i = 0; i < 4; i++)
+	if (tail == spiQueueHead)
 	{
-		SPDR = 0;
-		while(!(SPSR & (1<<SPIF)));
-		val[i] = SPDR;
+		return 0;
 	}
-	
-	SPI_PORT |= _BV(SPI_SS);
-
-	if (val[3] & _BV(0))
+	if ((int32_t)(spiQueue[tail & SPI_QUEUE_MASK].Time - before) >= 0)
 	{
-		return 65535;
+		return 0; // Belongs to a later control event
 	}
-	else if (val[3] & _BV(1))
+	*sample = spiQueue[tail & SPI_QUEUE_MASK];
+	spiQueueTail = tail + 1; // Only release the slot once it has been copied
+
+	// Linearised here rather than in the interrupt, it takes a few hundred cycles
+	sample->Value = spi_temperature(sample);
+	return 1;
+}
+
+//==============================================================================================================================
+// Temperature of a decoded frame in 0.25c steps, with the type K correction the converter doesn't do itself
+
+uint16_t spi_temperature (const SPI_SAMPLE *sample)
+{
+#ifdef MAX31855
+	if (!sample->Faults)
 	{
-		return 65534;
+		return TypeKLinearise(sample->Value, sample->Junction);
 	}
-	else if (val[3] & _BV(2))
+#endif
+	return sample->Value;
+}
+
+//==============================================================================================================================
+// One byte of the frame has been clocked in
+
+ISR (SPI_STC_vect)
+{
+	uint8_t head;
+	SPI_SAMPLE sample;
+
+	spiFrame[spiFrameIdx++] = SPDR;
+	if (spiFrameIdx < SPI_FRAME_LEN)
 	{
-		return 65533;
+		SPDR = 0;
+		return;
 	}
 
-	return ((val[0] << 8) | (val[1])) >> 2;
+	SPI_PORT |= _BV(SPI_SS);
+	SPCR &= ~_BV(SPIE);
+	spiBusy = false;
+
+	sample.Time = TimerNow(); // Timer1 counts, the same clock as the control events
+	spi_decode(spiFrame, &sample);
+	SafetyCheckSample(&sample, spiStart); // Even if the queue is full
+
+	head = spiQueueHead;
+	if ((uint8_t)(head - spiQueueTail) >= SPI_QUEUE_LEN)
+	{
+		spiOverruns++; // Main loop has fallen a whole queue behind, drop the new sample
+		return;
+	}
+	spiQueue[head & SPI_QUEUE_MASK] = sample;
+	spiQueueHead = head + 1;
 }
-#endif
 
 //==============================================================================================================================
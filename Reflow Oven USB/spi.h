@@ -12,7 +12,40 @@
 #ifndef SPI_H_
 #define SPI_H_
 
+//==============================================================================================================================
+// Defines
+
+// SPI_SAMPLE.Faults bits, the low three match the MAX31855 frame
+#define SPI_FAULT_OC		0x01		// Thermocouple open circuit
+#define SPI_FAULT_SCG		0x02		// Thermocouple shorted to GND
+#define SPI_FAULT_SCV		0x04		// Thermocouple shorted to VCC
+#define SPI_FAULT_ANY		0x80		// Converter fault bit (D16)
+
+//==============================================================================================================================
+// Typedefs
+
+typedef struct
+{
+	uint16_t Value;			// Temperature in 0.25c steps, or 65533-65535 for a fault
+	int16_t Junction;		// Converter cold junction temperature in 0.0625c steps
+	uint8_t Faults;			// SPI_FAULT_ bits
+	uint32_t Time;			// Timer1 counts (8us) when the frame completed
+} SPI_SAMPLE;
+
+//==============================================================================================================================
+// Global Variables
+
+extern volatile uint8_t spiOverruns;
+
+//==============================================================================================================================
+// Function Prototypes
+
 	void spi_init (void);
-	unsigned int spi_read (void);
+	void spi_start (void);
+	uint8_t spi_get_sample (SPI_SAMPLE*, uint32_t);
+	uint16_t spi_temperature (const SPI_SAMPLE*);
+
+	// Supplied by the control core, sees every frame from the interrupt as soon as it is decoded
+	void SafetyCheckSample (const SPI_SAMPLE*, uint32_t);
 
 #endif /* SPI_H_ */
\ No newline at end of file
@@ -0,0 +1,102 @@
+//==============================================================================================================================
+// T E L E M E T R Y
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Telemetry.c"
+// Title 			: Binary telemetry records, CRC-16 and COBS framing
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2 (or host, see hal.h)
+// Author			: Simon Ratcliffe
+//
+// A record goes out as a frame: a zero byte, the record and its CRC-16 (XMODEM, little-endian) COBS encoded so they hold
+// no zeros, and a closing zero byte. The replies and messages that stay ASCII lines never contain a zero, so a reader can
+// take everything between a pair of zeros as a frame and everything else as text.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "hal.h"
+
+#include "telemetry.h"
+
+//==============================================================================================================================
+// Global Variables
+
+uint8_t telemetryMode = TELEMETRY_CSV;
+
+//==============================================================================================================================
+// Private variables
+
+static uint16_t telemetrySeq = 0;
+
+//==============================================================================================================================
+// Functions
+
+bool setTelemetryMode(uint8_t mode)
+{
+	if ((mode != TELEMETRY_CSV) && (mode != TELEMETRY_BINARY))
+	{
+		return false;
+	}
+	telemetryMode = mode;
+	telemetrySeq = 0;
+	return true;
+}
+
+//==============================================================================================================================
+// COBS encode length bytes from src into dst, which needs room for one more byte per 254. Returns the encoded length.
+
+static uint8_t CobsEncode(const uint8_t *src, uint8_t length, uint8_t *dst)
+{
+	uint8_t *start = dst;
+	uint8_t *code = dst++; // Where the length of the current run of non zero bytes goes
+	uint8_t run = 1;
+
+	while (length--)
+	{
+		if (*src)
+		{
+			*dst++ = *src;
+			run++;
+		}
+		if ((*src == 0) || (run == 0xFF))
+		{
+			*code = run;
+			code = dst++;
+			run = 1;
+		}
+		src++;
+	}
+	*code = run;
+
+	return dst - start;
+}
+
+//==============================================================================================================================
+// Stamp the next sequence number into a record and send it as a frame
+
+void TelemetrySend(FILE *stream, void *record, uint8_t length)
+{
+	uint8_t raw[TELEMETRY_MAX_RECORD + 2];
+	uint8_t frame[TELEMETRY_MAX_RECORD + 5];
+	uint16_t crc = 0;
+	uint8_t i;
+
+	memcpy(raw, record, length);
+	raw[1] = telemetrySeq;
+	raw[2] = telemetrySeq >> 8;
+	telemetrySeq++;
+	for (i = 0; i < length; i++)
+	{
+		crc = _crc_xmodem_update(crc, raw[i]);
+	}
+	raw[length] = crc;
+	raw[length + 1] = crc >> 8;
+
+	frame[0] = 0;
+	i = CobsEncode(raw, length + 2, frame + 1);
+	frame[i + 1] = 0;
+	fwrite(frame, 1, i + 2, stream);
+}
@@ -0,0 +1,61 @@
+//==============================================================================================================================
+// T E L E M E T R Y
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "Telemetry.h"
+// Title 			: Binary telemetry records, CRC-16 and COBS framing
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2 (or host, see hal.h)
+// Author			: Simon Ratcliffe
+
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+//==============================================================================================================================
+// Defines
+
+// telemetryMode, set by **TELEM=CSV or **TELEM=BIN
+#define TELEMETRY_CSV			0
+#define TELEMETRY_BINARY	1
+
+// Record types, the first byte of every record
+#define TELEMETRY_SAMPLE	1
+
+#define TELEMETRY_MAX_RECORD	32
+
+//==============================================================================================================================
+// Typedefs
+
+// Sent once a control tick in binary mode, the same fields as the CSV line. Little-endian with no padding, every record
+// starts with Type and Seq.
+typedef struct
+{
+	uint8_t Type;							// TELEMETRY_SAMPLE
+	uint16_t Seq;							// One more than the last record sent, filled in by TelemetrySend
+	uint8_t Stage;						// ovenStage
+	uint32_t Time;						// ms into the run
+	uint16_t Temp;						// 0.25c steps, or 65533-65535 for a fault
+	uint8_t Duty;							// %
+	int16_t Delta4;
+	int16_t Delta16;
+	int16_t Delta32;
+	int16_t Rate;
+	int16_t Error;						// 0.25c steps
+	int16_t Junction;					// Cold junction in 0.0625c steps
+	uint8_t Faults;						// SPI_FAULT_ bits
+} __attribute__((packed)) TELEMETRY_SAMPLE_RECORD;
+
+//==============================================================================================================================
+// Global Variables
+
+extern uint8_t telemetryMode;
+
+//==============================================================================================================================
+// Function Prototypes
+
+	bool setTelemetryMode(uint8_t);
+	void TelemetrySend(FILE*, void*, uint8_t);
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,118 @@
+//==============================================================================================================================
+// T Y P E   K   L I N E A R I S A T I O N
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "TypeK.c"
+// Title 			: NIST type K correction of MAX31855 readings
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+//
+// The MAX31855 turns the thermocouple voltage into a temperature assuming a straight 41.276uV/c, which reads a few
+// degrees low around the reflow peak. The reading is turned back into the measured voltage, the cold junction voltage
+// is added and the result looked up in a table of the NIST ITS-90 curve. Everything is integer, the one division is
+// 16 bit.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "hal.h"
+
+#include "typek.h"
+
+//==============================================================================================================================
+// Defines
+
+#define TYPEK_SEEBECK_MUL	10567		// 41.276uV/c for 1/16c steps as a fraction of 4096
+#define TYPEK_VALUE_MAX		8191		// Largest MAX31855 reading (2047.75c)
+
+//==============================================================================================================================
+// PROGMEM Data
+
+// Thermocouple voltage (uV) from TYPEK_MIN in 8c steps, generated by Simulator/typekgen
+static const int16_t TypeKTable[TYPEK_ENTRIES] PROGMEM =
+{
+	-1527, -1231, -930, -624, -314, 0, 317, 637, 960, 1285, 1612, 1941,
+	2271, 2602, 2934, 3267, 3599, 3931, 4262, 4591, 4920, 5247, 5572, 5896,
+	6219, 6540, 6861, 7180, 7500, 7819, 8138, 8458, 8779, 9101, 9423, 9747,
+	10072, 10398, 10725, 11053, 11382, 11712, 12043, 12374, 12707, 13040, 13373, 13707,
+	14042, 14377, 14713, 15049, 15385, 15722, 16059, 16397
+};
+
+//==============================================================================================================================
+// Voltage (uV) of a thermocouple at t (1/16c steps) with its reference at 0c
+
+int16_t TypeKVoltage(int16_t t)
+{
+	int16_t offset = t - TYPEK_MIN * 16;
+	int16_t idx = offset >> (TYPEK_STEP_SHIFT + 4);
+	int16_t e0, e1;
+
+	if (idx < 0)
+	{
+		idx = 0;
+	}
+	else if (idx > TYPEK_ENTRIES - 2)
+	{
+		idx = TYPEK_ENTRIES - 2;
+	}
+	offset -= (int16_t)idx << (TYPEK_STEP_SHIFT + 4);
+
+	e0 = pgm_read_word(&TypeKTable[idx]);
+	e1 = pgm_read_word(&TypeKTable[idx + 1]);
+
+	return e0 + (int16_t)(((int32_t)(e1 - e0) * offset) >> (TYPEK_STEP_SHIFT + 4));
+}
+
+//==============================================================================================================================
+// Corrected temperature (0.25c steps) for a MAX31855 reading (0.25c steps) and its cold junction (1/16c steps)
+
+uint16_t TypeKLinearise(uint16_t value, int16_t junction)
+{
+	int32_t uvLong;
+	int16_t uv;
+	uint8_t lo = 0;
+	uint8_t hi = TYPEK_ENTRIES - 1;
+	int16_t e0, e1;
+
+	if (value > TYPEK_VALUE_MAX) // Keeps the multiply in range, fault codes shouldn't get here
+	{
+		value = TYPEK_VALUE_MAX;
+	}
+	uvLong = (((((int32_t)value << 2) - junction) * TYPEK_SEEBECK_MUL) >> 12) + TypeKVoltage(junction);
+
+	// Clamped to the table while still 32 bit, so a reading past the top of the table can't wrap round to 0c
+	if (uvLong <= (int16_t)pgm_read_word(&TypeKTable[0]))
+	{
+		return 0; // Below the table, the oven is never this cold
+	}
+	if (uvLong >= (int16_t)pgm_read_word(&TypeKTable[TYPEK_ENTRIES - 1]))
+	{
+		return (TYPEK_MIN + ((TYPEK_ENTRIES - 1) << TYPEK_STEP_SHIFT)) * 4;
+	}
+	uv = uvLong;
+
+	// Find the entry at or below the voltage, the table is monotonic
+	while (hi - lo > 1)
+	{
+		uint8_t mid = (lo + hi) >> 1;
+
+		if ((int16_t)pgm_read_word(&TypeKTable[mid]) <= uv)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	e0 = pgm_read_word(&TypeKTable[lo]);
+	e1 = pgm_read_word(&TypeKTable[lo + 1]);
+	value = ((uint16_t)(uv - e0) * (4 << TYPEK_STEP_SHIFT) + (uint16_t)(e1 - e0) / 2) / (uint16_t)(e1 - e0);
+	value += (TYPEK_MIN + ((int16_t)lo << TYPEK_STEP_SHIFT)) * 4;
+
+	return ((int16_t)value < 0) ? 0 : value;
+}
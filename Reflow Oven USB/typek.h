@@ -0,0 +1,29 @@
+//==============================================================================================================================
+// T Y P E   K   L I N E A R I S A T I O N
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "TypeK.h"
+// Title 			: NIST type K correction of MAX31855 readings
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+
+
+#ifndef TYPEK_H_
+#define TYPEK_H_
+
+//==============================================================================================================================
+// Defines
+
+#define TYPEK_MIN				-40		// Temperature of the first table entry (c)
+#define TYPEK_STEP_SHIFT	3			// Table entries are 8c apart
+#define TYPEK_ENTRIES		56		// Up to 400c
+
+//==============================================================================================================================
+// Function Prototypes
+
+	int16_t TypeKVoltage(int16_t);
+	uint16_t TypeKLinearise(uint16_t, int16_t);
+
+#endif /* TYPEK_H_ */
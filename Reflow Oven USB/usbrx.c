@@ -0,0 +1,74 @@
+//==============================================================================================================================
+// U S B   C O M M A N D   L I N E S
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "UsbRx.c"
+// Title 			: Host command lines from the CDC data OUT endpoint
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+//
+// A command can arrive split over any number of OUT packets, or share one with the next command, so the USB task takes
+// what the endpoint holds a byte at a time and only hands on a line once its CR or LF has arrived.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "hal.h"
+
+#ifndef HOST_BUILD
+#include "Descriptors.h"
+#endif
+#include "usbrx.h"
+
+//==============================================================================================================================
+// Private variables
+
+static USB_ClassInfo_CDC_Device_t *rxInterface;
+
+//==============================================================================================================================
+// Functions
+
+void UsbRxInit(USB_ClassInfo_CDC_Device_t *cdc)
+{
+	rxInterface = cdc;
+}
+
+//==============================================================================================================================
+// Take whatever the OUT endpoint holds into buf, a byte at a time, and return true once it holds a whole command (without
+// its CR or LF). A partial line stays in buf until the rest arrives on a later pass, so buf has to be the same buffer every
+// call. Blank lines are skipped and a line too long for buf is thrown away.
+
+bool UsbRxGetLine(char *buf, uint8_t size)
+{
+	static uint8_t length = 0;
+	static bool overflow = false;
+	int16_t c;
+
+	while ((c = CDC_Device_ReceiveByte(rxInterface)) >= 0)
+	{
+		if ((c == '\r') || (c == '\n'))
+		{
+			if ((length) && (!overflow))
+			{
+				buf[length] = 0;
+				length = 0;
+				return true;
+			}
+			length = 0;
+			overflow = false;
+		}
+		else if (length < size - 1)
+		{
+			buf[length++] = c;
+		}
+		else
+		{
+			overflow = true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,22 @@
+//==============================================================================================================================
+// U S B   C O M M A N D   L I N E S
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "UsbRx.h"
+// Title 			: Host command lines from the CDC data OUT endpoint
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+
+
+#ifndef USBRX_H_
+#define USBRX_H_
+
+//==============================================================================================================================
+// Function Prototypes
+
+	void UsbRxInit(USB_ClassInfo_CDC_Device_t*);
+	bool UsbRxGetLine(char*, uint8_t);
+
+#endif /* USBRX_H_ */
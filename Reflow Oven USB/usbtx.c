@@ -0,0 +1,161 @@
+//==============================================================================================================================
+// U S B   T R A N S M I T   B U F F E R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "UsbTx.c"
+// Title 			: RAM ring buffer between the stdio writers and the CDC data IN endpoint
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+//
+// Writing to USBSerialStream only ever appends to the ring, so nothing in the main loop waits on the host. The USB task
+// moves what it can into the endpoint banks each pass. When the ring is full the oldest whole message (a text line or a
+// zero delimited telemetry frame) is dropped to make room and counted. While no program has the port open there is no
+// one to read it, so writes are thrown away instead of filling the ring with data that would be stale when one does.
+
+
+//==============================================================================================================================
+// Includes
+
+#include "hal.h"
+
+#ifndef HOST_BUILD
+#include "Descriptors.h"
+#endif
+#include "usbtx.h"
+
+//==============================================================================================================================
+// Private variables
+
+static USB_ClassInfo_CDC_Device_t *txInterface;
+static uint8_t txBuf[USB_TX_SIZE];
+static uint8_t txHead = 0;				// Free running, the count is head - tail
+static uint8_t txTail = 0;
+static uint8_t txDepthMax = 0;
+static uint16_t txDropMessages = 0;
+static uint16_t txDropBytes = 0;
+static volatile bool txReader = false;	// Cleared by the disconnect interrupt
+
+//==============================================================================================================================
+// Function Prototypes (Private)
+
+static int UsbTxPut(char, FILE*);
+
+//==============================================================================================================================
+// Functions
+
+void UsbTxInit(USB_ClassInfo_CDC_Device_t *cdc, FILE *stream)
+{
+	txInterface = cdc;
+	fdev_setup_stream(stream, UsbTxPut, NULL, _FDEV_SETUP_WRITE);
+}
+
+//==============================================================================================================================
+// Drop the oldest message. A frame runs from its opening zero to its closing one, anything else up to a newline. If the
+// ring holds only part of a message (the one being written is longer than the ring) that part goes.
+
+static void UsbTxDropOldest(void)
+{
+	uint8_t c = txBuf[txTail & USB_TX_MASK];
+	bool frame = (c == 0);
+	uint8_t dropped = 0;
+
+	do
+	{
+		c = txBuf[txTail++ & USB_TX_MASK];
+		dropped++;
+		if ((frame) ? ((c == 0) && (dropped > 1)) : (c == '\n'))
+		{
+			break;
+		}
+	}
+	while (txHead != txTail);
+
+	if (txDropMessages < UINT16_MAX)
+	{
+		txDropMessages++;
+	}
+	txDropBytes = ((uint16_t)(UINT16_MAX - txDropBytes) < dropped) ? UINT16_MAX : txDropBytes + dropped;
+}
+
+//==============================================================================================================================
+// Start or stop taking writes. Whatever was left from the last reader is thrown away when the next one arrives, so this
+// only touches the ring when called from the main loop with present true.
+
+void UsbTxSetReader(bool present)
+{
+	if ((present) && (!txReader))
+	{
+		txTail = txHead;
+	}
+	txReader = present;
+}
+
+bool UsbTxHasReader(void)
+{
+	return txReader;
+}
+
+//==============================================================================================================================
+// Bytes that can be written without dropping anything
+
+uint8_t UsbTxFree(void)
+{
+	return USB_TX_SIZE - (uint8_t)(txHead - txTail);
+}
+
+//==============================================================================================================================
+// stdio put for USBSerialStream
+
+static int UsbTxPut(char c, FILE *stream)
+{
+	uint8_t depth;
+
+	if (!txReader)
+	{
+		return 0;
+	}
+	if ((uint8_t)(txHead - txTail) >= USB_TX_SIZE)
+	{
+		UsbTxDropOldest();
+	}
+	txBuf[txHead++ & USB_TX_MASK] = c;
+
+	depth = txHead - txTail;
+	if (depth > txDepthMax)
+	{
+		txDepthMax = depth;
+	}
+	return 0;
+}
+
+//==============================================================================================================================
+// Fill the data IN endpoint banks from the ring while the host has one free, a full bank goes as soon as it fills. Any
+// short packet left over is sent by CDC_Device_USBTask.
+
+void UsbTxDrain(void)
+{
+	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(txInterface->State.LineEncoding.BaudRateBPS))
+	{
+		return;
+	}
+
+	Endpoint_SelectEndpoint(txInterface->Config.DataINEndpoint.Address);
+	while ((txHead != txTail) && (Endpoint_IsINReady()))
+	{
+		Endpoint_Write_8(txBuf[txTail++ & USB_TX_MASK]);
+		if (!Endpoint_IsReadWriteAllowed())
+		{
+			Endpoint_ClearIN();
+		}
+	}
+}
+
+//==============================================================================================================================
+// Send the messages and bytes dropped and the most the ring has held
+
+void UsbTxReport(FILE *stream)
+{
+	fprintf_P(stream, PSTR("=TX,%u,%u,%u\n"), txDropMessages, txDropBytes, txDepthMax);
+}
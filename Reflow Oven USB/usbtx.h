@@ -0,0 +1,32 @@
+//==============================================================================================================================
+// U S B   T R A N S M I T   B U F F E R
+//
+// Copyright	: 2011 ProAtomic Software Development Pty Ltd
+// File Name	: "UsbTx.h"
+// Title 			: RAM ring buffer between the stdio writers and the CDC data IN endpoint
+// Date 			: 18 Jul 2011
+// Version 		: 1.00
+// Target MCU : ATMEGA32U2
+// Author			: Simon Ratcliffe
+
+
+#ifndef USBTX_H_
+#define USBTX_H_
+
+//==============================================================================================================================
+// Defines
+
+#define USB_TX_SIZE				128	// Power of two, no more than 128
+#define USB_TX_MASK				(USB_TX_SIZE - 1)
+
+//==============================================================================================================================
+// Function Prototypes
+
+	void UsbTxInit(USB_ClassInfo_CDC_Device_t*, FILE*);
+	void UsbTxSetReader(bool);
+	bool UsbTxHasReader(void);
+	uint8_t UsbTxFree(void);
+	void UsbTxDrain(void);
+	void UsbTxReport(FILE*);
+
+#endif /* USBTX_H_ */